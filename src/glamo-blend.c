@@ -0,0 +1,542 @@
+/*
+ * Copyright  2007 OpenMoko, Inc.
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation, and
+ * that the name of the copyright holders not be used in advertising or
+ * publicity pertaining to distribution of the software without specific,
+ * written prior permission.  The copyright holders make no representations
+ * about the suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO
+ * EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE,
+ * DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER
+ * TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+ * OF THIS SOFTWARE.
+ */
+
+/*
+ * Render composites the 2D engine can't do because they blend.  The common
+ * ones on an r5g6b5 destination are done here by the CPU instead of by
+ * the generic fallback: Over from an a8r8g8b8 picture, and Over from a
+ * solid colour, through an a8 mask or not.  Spans of the destination are
+ * read into a row in system memory, blended there and written back to
+ * VRAM sequentially.  Pixmaps with a readback cache are read from it.
+ *
+ * Src from an a8r8g8b8 or x8r8g8b8 picture doesn't blend, but needs a
+ * conversion the 2D engine can't do either.  The source pixels are
+ * converted as they are written to the destination, in one pass, read
+ * from a readback cache if the source has one and from VRAM otherwise.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+#include <string.h>
+#include "glamo.h"
+
+#if defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
+/* Pixels blended at a time */
+#define GLAMO_BLEND_SPAN	256
+
+/* Mask of a solid source composited without one */
+static CARD8 GLAMOBlendOpaque[GLAMO_BLEND_SPAN];
+
+/* x / 255, rounded, for x up to 255 * 255 */
+static inline CARD32
+GLAMODiv255(CARD32 x)
+{
+	x += 128;
+	return (x + (x >> 8)) >> 8;
+}
+
+/* All four channels of c times m / 255 */
+static inline CARD32
+GLAMOMulAlpha(CARD32 c, CARD32 m)
+{
+	CARD32 rb = (c & 0x00ff00ff) * m + 0x00800080;
+	CARD32 ag = ((c >> 8) & 0x00ff00ff) * m + 0x00800080;
+
+	rb = ((rb + ((rb >> 8) & 0x00ff00ff)) >> 8) & 0x00ff00ff;
+	ag = (ag + ((ag >> 8) & 0x00ff00ff)) & 0xff00ff00;
+
+	return rb | ag;
+}
+
+static inline CARD16
+GLAMOPack565(CARD32 c)
+{
+	return ((c >> 8) & 0xf800) | ((c >> 5) & 0x07e0) | ((c >> 3) & 0x001f);
+}
+
+static inline CARD16
+GLAMOOver565(CARD32 s, CARD16 d)
+{
+	CARD32 ia = 255 - (s >> 24);
+	CARD32 r, g, b;
+
+	r = (d >> 8) & 0xf8;
+	g = (d >> 3) & 0xfc;
+	b = (d << 3) & 0xf8;
+	r |= r >> 5;
+	g |= g >> 6;
+	b |= b >> 5;
+
+	r = min(((s >> 16) & 0xff) + GLAMODiv255(r * ia), 255);
+	g = min(((s >> 8) & 0xff) + GLAMODiv255(g * ia), 255);
+	b = min((s & 0xff) + GLAMODiv255(b * ia), 255);
+
+	return ((r & 0xf8) << 8) | ((g & 0xfc) << 3) | (b >> 3);
+}
+
+static void
+GLAMOOverRowC(CARD16 *dst, const CARD32 *src, int n)
+{
+	CARD32 s;
+	int i;
+
+	for (i = 0; i < n; i++) {
+		s = src[i];
+		if (s >= 0xff000000)
+			dst[i] = GLAMOPack565(s);
+		else if (s)
+			dst[i] = GLAMOOver565(s, dst[i]);
+	}
+}
+
+static void
+GLAMOOverMaskRowC(CARD16 *dst, CARD32 color, const CARD8 *mask, int n)
+{
+	CARD32 m;
+	int i;
+
+	for (i = 0; i < n; i++) {
+		m = mask[i];
+		if (m == 0xff)
+			dst[i] = GLAMOOver565(color, dst[i]);
+		else if (m)
+			dst[i] = GLAMOOver565(GLAMOMulAlpha(color, m), dst[i]);
+	}
+}
+
+#if defined(__arm__)
+/*
+ * For cores without SIMD: the destination is spread out as 0x07e0f81f so
+ * one multiply scales all three channels, by the inverse alpha cut down
+ * to 0..32.  The scaled destination never exceeds what is left over by
+ * the premultiplied source, so the channels can be added without carries.
+ */
+static inline CARD16
+GLAMOOver565Packed(CARD32 s, CARD16 d)
+{
+	CARD32 ia = 255 - (s >> 24);
+	CARD32 d32 = (d | (d << 16)) & 0x07e0f81f;
+
+	ia = (ia + (ia >> 7)) >> 3;
+
+	d32 = ((d32 * ia) >> 5) & 0x07e0f81f;
+
+	return GLAMOPack565(s) + (CARD16) (d32 | (d32 >> 16));
+}
+
+static void
+GLAMOOverRowArm(CARD16 *dst, const CARD32 *src, int n)
+{
+	CARD32 s;
+	int i;
+
+	for (i = 0; i < n; i++) {
+#ifdef GLAMO_HAVE_PLD
+		if (!(i & 7))
+			__asm__ __volatile__("pld [%0, #64]" : : "r" (src + i));
+#endif
+		s = src[i];
+		if (s >= 0xff000000)
+			dst[i] = GLAMOPack565(s);
+		else if (s)
+			dst[i] = GLAMOOver565Packed(s, dst[i]);
+	}
+}
+
+static void
+GLAMOOverMaskRowArm(CARD16 *dst, CARD32 color, const CARD8 *mask, int n)
+{
+	CARD32 m;
+	int i;
+
+	for (i = 0; i < n; i++) {
+		m = mask[i];
+		if (m == 0xff)
+			dst[i] = GLAMOOver565Packed(color, dst[i]);
+		else if (m)
+			dst[i] = GLAMOOver565Packed(GLAMOMulAlpha(color, m),
+						    dst[i]);
+	}
+}
+#endif /* __arm__ */
+
+#if defined(__ARM_NEON__)
+/* t / 255, rounded, narrowed to 8 bits */
+static inline uint8x8_t
+GLAMODiv255Neon(uint16x8_t t)
+{
+	return vraddhn_u16(t, vrshrq_n_u16(t, 8));
+}
+
+/* Eight pixels, source channels in b, g, r, a order as vld4 loads them. */
+static inline uint16x8_t
+GLAMOOver8Neon(uint8x8x4_t s, uint16x8_t d)
+{
+	uint8x8_t ia = vmvn_u8(s.val[3]);
+	uint8x8_t r, g, b;
+	uint16x8_t out;
+
+	r = vshrn_n_u16(d, 8);
+	g = vshrn_n_u16(d, 3);
+	b = vmovn_u16(vshlq_n_u16(d, 3));
+	r = vsri_n_u8(r, r, 5);
+	g = vsri_n_u8(g, g, 6);
+	b = vsri_n_u8(b, b, 5);
+
+	r = vqadd_u8(s.val[2], GLAMODiv255Neon(vmull_u8(r, ia)));
+	g = vqadd_u8(s.val[1], GLAMODiv255Neon(vmull_u8(g, ia)));
+	b = vqadd_u8(s.val[0], GLAMODiv255Neon(vmull_u8(b, ia)));
+
+	out = vshll_n_u8(r, 8);
+	out = vsriq_n_u16(out, vshll_n_u8(g, 8), 5);
+	out = vsriq_n_u16(out, vshll_n_u8(b, 8), 11);
+
+	return out;
+}
+
+static void
+GLAMOOverRowNeon(CARD16 *dst, const CARD32 *src, int n)
+{
+	uint8x8x4_t s;
+
+	while (n >= 8) {
+		__builtin_prefetch(src + 32);
+		s = vld4_u8((const uint8_t *) src);
+		vst1q_u16(dst, GLAMOOver8Neon(s, vld1q_u16(dst)));
+		src += 8;
+		dst += 8;
+		n -= 8;
+	}
+
+	GLAMOOverRowC(dst, src, n);
+}
+
+static void
+GLAMOOverMaskRowNeon(CARD16 *dst, CARD32 color, const CARD8 *mask, int n)
+{
+	uint8x8_t cb = vdup_n_u8((uint8_t) color);
+	uint8x8_t cg = vdup_n_u8((uint8_t) (color >> 8));
+	uint8x8_t cr = vdup_n_u8((uint8_t) (color >> 16));
+	uint8x8_t ca = vdup_n_u8((uint8_t) (color >> 24));
+	uint8x8x4_t s;
+	uint8x8_t m;
+
+	while (n >= 8) {
+		m = vld1_u8(mask);
+		s.val[0] = GLAMODiv255Neon(vmull_u8(cb, m));
+		s.val[1] = GLAMODiv255Neon(vmull_u8(cg, m));
+		s.val[2] = GLAMODiv255Neon(vmull_u8(cr, m));
+		s.val[3] = GLAMODiv255Neon(vmull_u8(ca, m));
+		vst1q_u16(dst, GLAMOOver8Neon(s, vld1q_u16(dst)));
+		mask += 8;
+		dst += 8;
+		n -= 8;
+	}
+
+	GLAMOOverMaskRowC(dst, color, mask, n);
+}
+#endif /* __ARM_NEON__ */
+
+void
+GLAMOBlendInit(ScrnInfoPtr pScrn)
+{
+	GlamoPtr pGlamo = GlamoPTR(pScrn);
+
+	memset(GLAMOBlendOpaque, 0xff, sizeof(GLAMOBlendOpaque));
+
+	pGlamo->blend_over = GLAMOOverRowC;
+	pGlamo->blend_over_mask = GLAMOOverMaskRowC;
+	pGlamo->blend_name = "C";
+
+#if defined(__arm__)
+	pGlamo->blend_over = GLAMOOverRowArm;
+	pGlamo->blend_over_mask = GLAMOOverMaskRowArm;
+	pGlamo->blend_name = "ARMv5";
+#endif
+
+#if defined(__ARM_NEON__)
+	if (GLAMOHaveNeon()) {
+		pGlamo->blend_over = GLAMOOverRowNeon;
+		pGlamo->blend_over_mask = GLAMOOverMaskRowNeon;
+		pGlamo->blend_name = "NEON";
+	}
+#endif
+
+	xf86DrvMsg(pScrn->scrnIndex, X_INFO, "Using %s blend kernels\n",
+		   pGlamo->blend_name);
+}
+
+static Bool
+GLAMOBlendIsSolid(PicturePtr pPicture)
+{
+	return pPicture->repeat &&
+	       pPicture->pDrawable->width == 1 &&
+	       pPicture->pDrawable->height == 1;
+}
+
+/* A picture read as it is: no transform, repeat or alpha map. */
+static Bool
+GLAMOBlendIsPlain(PicturePtr pPicture)
+{
+	return pPicture->pDrawable && !pPicture->transform &&
+	       !pPicture->repeat && !pPicture->alphaMap;
+}
+
+/*
+ * Over to an r5g6b5 picture, from a plain a8r8g8b8 picture or from a solid
+ * colour, the latter through an optional plain a8 mask.
+ */
+Bool
+GLAMOBlendCheck(int op, PicturePtr pSrcPicture, PicturePtr pMaskPicture,
+		PicturePtr pDstPicture)
+{
+	if (op != PictOpOver || pDstPicture->format != PICT_r5g6b5 ||
+	    pDstPicture->alphaMap)
+		return FALSE;
+
+	if (pMaskPicture &&
+	    (!GLAMOBlendIsPlain(pMaskPicture) ||
+	     pMaskPicture->format != PICT_a8 ||
+	     pMaskPicture->componentAlpha))
+		return FALSE;
+
+	if (!pSrcPicture->pDrawable || pSrcPicture->alphaMap ||
+	    pSrcPicture->transform)
+		return FALSE;
+
+	if (GLAMOBlendIsSolid(pSrcPicture))
+		return pSrcPicture->format == PICT_a8r8g8b8 ||
+		       pSrcPicture->format == PICT_x8r8g8b8 ||
+		       pSrcPicture->format == PICT_r5g6b5;
+
+	return !pMaskPicture && GLAMOBlendIsPlain(pSrcPicture) &&
+	       pSrcPicture->format == PICT_a8r8g8b8;
+}
+
+/*
+ * Where the CPU reads a pixmap: its readback cache, or VRAM once the
+ * blitter is done with it.
+ */
+CARD8 *
+GLAMOBlendPixels(GlamoPtr pGlamo, PixmapPtr pPix)
+{
+	CARD8 *cache = GLAMOPixmapCache(pGlamo, pPix);
+
+	if (cache)
+		return cache;
+
+	GLAMOPixmapWait(pGlamo, pPix);
+	return pGlamo->exa->memoryBase + GLAMOPixmapOffset(pPix);
+}
+
+/* The premultiplied a8r8g8b8 colour of a 1x1 picture */
+static CARD32
+GLAMOBlendReadSolid(GlamoPtr pGlamo, PixmapPtr pPix, PictFormatShort format)
+{
+	CARD8 *ptr = GLAMOBlendPixels(pGlamo, pPix);
+	CARD32 pixel, r, g, b;
+
+	switch (format) {
+	case PICT_r5g6b5:
+		pixel = *(CARD16 *)ptr;
+		r = (pixel >> 8) & 0xf8;
+		g = (pixel >> 3) & 0xfc;
+		b = (pixel << 3) & 0xf8;
+		return 0xff000000 | (r | r >> 5) << 16 | (g | g >> 6) << 8 |
+		       (b | b >> 5);
+	case PICT_x8r8g8b8:
+		return *(CARD32 *)ptr | 0xff000000;
+	default:
+		return *(CARD32 *)ptr;
+	}
+}
+
+Bool
+GLAMOBlendPrepare(GlamoPtr pGlamo, PicturePtr pSrcPicture, PixmapPtr pSrc,
+		  PixmapPtr pMask, PixmapPtr pDst)
+{
+	/* Source rows are read while destination rows are written. */
+	if (pSrc == pDst || pMask == pDst)
+		return FALSE;
+
+	pGlamo->blend_src = NULL;
+	pGlamo->blend_mask = NULL;
+
+	if (GLAMOBlendIsSolid(pSrcPicture)) {
+		pGlamo->blend_color = GLAMOBlendReadSolid(pGlamo, pSrc,
+							  pSrcPicture->format);
+	} else {
+		pGlamo->blend_src = GLAMOBlendPixels(pGlamo, pSrc);
+		pGlamo->blend_src_pitch = pSrc->devKind;
+		/* VRAM pixmaps are only 2 byte aligned. */
+		if ((unsigned long)pGlamo->blend_src & 3)
+			return FALSE;
+	}
+
+	if (pMask) {
+		pGlamo->blend_mask = GLAMOBlendPixels(pGlamo, pMask);
+		pGlamo->blend_mask_pitch = pMask->devKind;
+	}
+
+	pGlamo->blend_dst_cache = GLAMOPixmapCache(pGlamo, pDst);
+	GLAMOPixmapSolid(pGlamo, pDst, FALSE, 0);
+	/* The destination in VRAM is written in any case. */
+	GLAMOPixmapWait(pGlamo, pDst);
+
+	return TRUE;
+}
+
+/*
+ * Blend a rectangle span by span.  The destination is read from its
+ * readback cache if it has one, which is then kept up to date with VRAM.
+ */
+void
+GLAMOBlendComposite(GlamoPtr pGlamo, PixmapPtr pDst, int srcX, int srcY,
+		    int maskX, int maskY, int dstX, int dstY,
+		    int width, int height)
+{
+	CARD16 row[GLAMO_BLEND_SPAN];
+	int pitch = pDst->devKind;
+	CARD8 *vram, *cache = NULL, *src = NULL, *mask = NULL;
+	const CARD8 *m;
+	int x, y, n;
+
+	vram = pGlamo->exa->memoryBase + GLAMOPixmapOffset(pDst) +
+	       dstY * pitch + dstX * 2;
+	if (pGlamo->blend_dst_cache)
+		cache = pGlamo->blend_dst_cache + dstY * pitch + dstX * 2;
+	if (pGlamo->blend_src)
+		src = pGlamo->blend_src + srcY * pGlamo->blend_src_pitch +
+		      srcX * 4;
+	if (pGlamo->blend_mask)
+		mask = pGlamo->blend_mask + maskY * pGlamo->blend_mask_pitch +
+		       maskX;
+
+	for (y = 0; y < height; y++) {
+		for (x = 0; x < width; x += n) {
+			n = min(width - x, GLAMO_BLEND_SPAN);
+
+			if (cache)
+				memcpy(row, cache + x * 2, n * 2);
+			else
+				pGlamo->download_row((CARD8 *)row,
+						     vram + x * 2, n * 2);
+
+			if (src) {
+				pGlamo->blend_over(row,
+						   (CARD32 *)(src + x * 4), n);
+			} else {
+				m = mask ? mask + x : GLAMOBlendOpaque;
+				pGlamo->blend_over_mask(row,
+							pGlamo->blend_color,
+							m, n);
+			}
+
+			pGlamo->upload_row(vram + x * 2, (CARD8 *)row, n * 2);
+			if (cache)
+				memcpy(cache + x * 2, row, n * 2);
+		}
+
+		vram += pitch;
+		if (cache)
+			cache += pitch;
+		if (src)
+			src += pGlamo->blend_src_pitch;
+		if (mask)
+			mask += pGlamo->blend_mask_pitch;
+	}
+}
+
+/*
+ * Src from a plain a8r8g8b8 or x8r8g8b8 picture to an r5g6b5 one, or Over
+ * from the latter as it is opaque.
+ */
+Bool
+GLAMOConvertCheck(int op, PicturePtr pSrcPicture, PicturePtr pMaskPicture,
+		  PicturePtr pDstPicture)
+{
+	if (pMaskPicture || pDstPicture->format != PICT_r5g6b5 ||
+	    pDstPicture->alphaMap || !GLAMOBlendIsPlain(pSrcPicture))
+		return FALSE;
+
+	switch (pSrcPicture->format) {
+	case PICT_a8r8g8b8:
+		return op == PictOpSrc;
+	case PICT_x8r8g8b8:
+		return op == PictOpSrc || op == PictOpOver;
+	default:
+		return FALSE;
+	}
+}
+
+/*
+ * Where the CPU reads an a8r8g8b8 or x8r8g8b8 pixmap to convert it: its
+ * readback cache, or VRAM.  The software fallback the conversion replaces
+ * reads the same source pixels from the same place, once each, so there
+ * is no size above which leaving it to software reads less VRAM.
+ */
+CARD8 *
+GLAMOConvertPixels(GlamoPtr pGlamo, PixmapPtr pSrc)
+{
+	CARD8 *cache = GLAMOPixmapCache(pGlamo, pSrc);
+
+	if (cache) {
+		pGlamo->convert_cached++;
+		return cache;
+	}
+
+	GLAMOPixmapWait(pGlamo, pSrc);
+	pGlamo->convert_vram++;
+	return pGlamo->exa->memoryBase + GLAMOPixmapOffset(pSrc);
+}
+
+Bool
+GLAMOConvertPrepare(GlamoPtr pGlamo, PixmapPtr pSrc, PixmapPtr pDst)
+{
+	pGlamo->blend_src = GLAMOConvertPixels(pGlamo, pSrc);
+	pGlamo->blend_src_pitch = pSrc->devKind;
+	if (!pGlamo->blend_src || (unsigned long)pGlamo->blend_src & 3)
+		return FALSE;
+
+	GLAMOPixmapWait(pGlamo, pDst);
+
+	return TRUE;
+}
+
+void
+GLAMOConvertComposite(GlamoPtr pGlamo, PixmapPtr pDst, int srcX, int srcY,
+		      int dstX, int dstY, int width, int height)
+{
+	int pitch = pDst->devKind;
+
+	GLAMOPixmapDirty(pGlamo, pDst, dstX, dstY, dstX + width, dstY + height);
+	GLAMOConvertRect(pGlamo,
+			 pGlamo->exa->memoryBase + GLAMOPixmapOffset(pDst) +
+			 dstY * pitch + dstX * 2, pitch,
+			 pGlamo->blend_src + srcY * pGlamo->blend_src_pitch +
+			 srcX * 4, pGlamo->blend_src_pitch,
+			 dstX, dstY, width, height);
+}
@@ -0,0 +1,175 @@
+/*
+ * Copyright  2007 OpenMoko, Inc.
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation, and
+ * that the name of the copyright holders not be used in advertising or
+ * publicity pertaining to distribution of the software without specific,
+ * written prior permission.  The copyright holders make no representations
+ * about the suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO
+ * EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE,
+ * DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER
+ * TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+ * OF THIS SOFTWARE.
+ */
+
+/*
+ * The 2D engine has no way to expand a 1bpp source on the fly, so glyphs
+ * and small bitmaps are expanded to 16bpp by the CPU once and kept in an
+ * offscreen surface, from where they are blitted like any other pixmap.
+ *
+ * Cells are looked up by their content and colours, so the cache does not
+ * care which font a glyph belongs to and survives fonts being closed and
+ * reopened.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+#include "glamo.h"
+#include "glamo-cmdq.h"
+
+#define GLAMO_MONO_CACHE_WIDTH	(GLAMO_MONO_CACHE_COLS * GLAMO_MONO_CELL_SIZE)
+#define GLAMO_MONO_CACHE_HEIGHT	(GLAMO_MONO_CACHE_ROWS * GLAMO_MONO_CELL_SIZE)
+
+static CARD32
+GLAMOMonoCacheHash(const CARD32 *bits, int width, int height,
+		   CARD16 fg, CARD16 bg)
+{
+	CARD32 hash = (width << 24) ^ (height << 16) ^ (fg << 8) ^ bg;
+	int y;
+
+	for (y = 0; y < height; y++)
+		hash = (hash * 31) ^ bits[y];
+
+	return hash;
+}
+
+Bool
+GLAMOMonoCacheInit(GlamoPtr pGlamo)
+{
+	GlamoMonoCachePtr cache = &pGlamo->mono_cache;
+	int i;
+
+	if (!cache->area) {
+		cache->pitch = GLAMO_MONO_CACHE_WIDTH * 2;
+		cache->area = GLAMOVRAMAlloc(pGlamo, GLAMO_VRAM_MONO_CACHE,
+					     cache->pitch *
+					     GLAMO_MONO_CACHE_HEIGHT);
+		if (!cache->area)
+			return FALSE;
+		cache->offset = cache->area->offset;
+	}
+
+	for (i = 0; i < GLAMO_MONO_CACHE_CELLS; i++) {
+		cache->cells[i].x = (i % GLAMO_MONO_CACHE_COLS) *
+				    GLAMO_MONO_CELL_SIZE;
+		cache->cells[i].y = (i / GLAMO_MONO_CACHE_COLS) *
+				    GLAMO_MONO_CELL_SIZE;
+		cache->cells[i].valid = FALSE;
+	}
+	cache->serial = 1;
+	cache->idle_serial = 1;
+
+	return TRUE;
+}
+
+void
+GLAMOMonoCacheFini(GlamoPtr pGlamo)
+{
+	GlamoMonoCachePtr cache = &pGlamo->mono_cache;
+
+	if (!cache->area)
+		return;
+
+	GLAMOVRAMFree(pGlamo, GLAMO_VRAM_MONO_CACHE, cache->area);
+	cache->area = NULL;
+}
+
+/*
+ * Called once the commands using the cells handed out so far have been
+ * dispatched; from now on those cells may be replaced again.
+ */
+void
+GLAMOMonoCacheNewBatch(GlamoPtr pGlamo)
+{
+	pGlamo->mono_cache.serial++;
+}
+
+/*
+ * Returns a cell holding the bitmap expanded to fg and bg, uploading it if
+ * it isn't cached yet.  Returns NULL if the bitmap is too large or all
+ * candidate cells are used by commands that haven't been flushed yet.
+ */
+GlamoMonoCellPtr
+GLAMOMonoCacheGet(GlamoPtr pGlamo, const CARD32 *bits, int width, int height,
+		  CARD16 fg, CARD16 bg)
+{
+	GlamoMonoCachePtr cache = &pGlamo->mono_cache;
+	GlamoMonoCellPtr set, cell, victim = NULL;
+	CARD32 hash, row;
+	CARD16 *dst;
+	int i, x, y;
+
+	if (!cache->area || width > GLAMO_MONO_CELL_SIZE ||
+	    height > GLAMO_MONO_CELL_SIZE)
+		return NULL;
+
+	hash = GLAMOMonoCacheHash(bits, width, height, fg, bg);
+	set = &cache->cells[(hash % GLAMO_MONO_CACHE_SETS) *
+			    GLAMO_MONO_CACHE_WAYS];
+
+	for (i = 0; i < GLAMO_MONO_CACHE_WAYS; i++) {
+		cell = &set[i];
+		if (cell->valid && cell->hash == hash &&
+		    cell->width == width && cell->height == height &&
+		    cell->fg == fg && cell->bg == bg &&
+		    !memcmp(cell->bits, bits, height * sizeof(CARD32))) {
+			cell->last_use = cache->serial;
+			cache->hits++;
+			return cell;
+		}
+		if (cell->valid && cell->last_use == cache->serial)
+			continue;
+		if (!victim || !cell->valid ||
+		    (victim->valid && cell->last_use < victim->last_use))
+			victim = cell;
+	}
+
+	if (!victim)
+		return NULL;
+
+	/* The blitter may still be reading the cell from an earlier batch. */
+	if (victim->valid && victim->last_use >= cache->idle_serial) {
+		GLAMOEngineWait(pGlamo, GLAMO_ENGINE_ALL);
+		cache->idle_serial = cache->serial;
+	}
+
+	dst = (CARD16 *) (pGlamo->exa->memoryBase + cache->offset +
+			  victim->y * cache->pitch) + victim->x;
+	for (y = 0; y < height; y++) {
+		row = bits[y];
+		for (x = 0; x < width; x++)
+			dst[x] = (row & ((CARD32) 1 << x)) ? fg : bg;
+		dst += cache->pitch / 2;
+	}
+
+	memcpy(victim->bits, bits, height * sizeof(CARD32));
+	victim->hash = hash;
+	victim->width = width;
+	victim->height = height;
+	victim->fg = fg;
+	victim->bg = bg;
+	victim->last_use = cache->serial;
+	victim->valid = TRUE;
+	cache->misses++;
+
+	return victim;
+}
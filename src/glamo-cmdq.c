@@ -282,6 +282,10 @@ GLAMOEngineWaitReal(GlamoPtr pGlamo,
 	do {
 		status = MMIO_IN16(mmio, GLAMO_REG_CMDQ_STATUS);
     } while ((status & mask) != val);
+
+	/* Everything dispatched so far has completed. */
+	if (engine == GLAMO_ENGINE_ALL)
+		pGlamo->fence_retired = pGlamo->fence;
 }
 
 void
@@ -291,6 +295,79 @@ GLAMOEngineWait(GlamoPtr pGlamo,
 	GLAMOEngineWaitReal(pGlamo, engine, TRUE);
 }
 
+static CARD32
+GLAMOCMDQReadPos(volatile char *mmio)
+{
+	return (MMIO_IN16(mmio, GLAMO_REG_CMDQ_READ_ADDRL) & CQ_MASKL) |
+	       ((MMIO_IN16(mmio, GLAMO_REG_CMDQ_READ_ADDRH) & CQ_MASKH) << 16);
+}
+
+/*
+ * Retire the batches the command queue has read all of, if the 2D engine
+ * is idle after that: their commands were all issued to it, and it has
+ * finished them.  The engine raises no interrupt, so this is polled when
+ * someone asks about a batch not yet known to be retired.
+ */
+static void
+GLAMOFenceUpdate(GlamoPtr pGlamo)
+{
+	volatile char *mmio = pGlamo->reg_base;
+	CARD32 read, write, end, len = pGlamo->ring_len;
+	CARD16 status;
+	unsigned long f;
+
+	if (!mmio)
+		return;
+
+	read = GLAMOCMDQReadPos(mmio);
+	write = MMIO_IN16(mmio, GLAMO_REG_CMDQ_WRITE_ADDRL) |
+		(MMIO_IN16(mmio, GLAMO_REG_CMDQ_WRITE_ADDRH) << 16);
+	status = MMIO_IN16(mmio, GLAMO_REG_CMDQ_STATUS);
+
+	if (status & (1 << 2)) {
+		pGlamo->fence_retired = pGlamo->fence;
+		return;
+	}
+	if ((status & (0x3 | (1 << 4))) != 0x3)
+		return;
+
+	/* Going round from the write position, read is past the end. */
+	for (f = pGlamo->fence_retired + 1; (long) (f - pGlamo->fence) <= 0;
+	     f++) {
+		end = pGlamo->fence_end[f % GLAMO_FENCE_RING];
+		if ((write - read + len) % len > (write - end + len) % len)
+			break;
+		pGlamo->fence_retired = f;
+	}
+}
+
+Bool
+GLAMOFenceRetired(GlamoPtr pGlamo, unsigned long fence)
+{
+	if ((long) (fence - pGlamo->fence_retired) <= 0)
+		return TRUE;
+
+	GLAMOFenceUpdate(pGlamo);
+	return (long) (fence - pGlamo->fence_retired) <= 0;
+}
+
+/*
+ * Wait for a command batch to complete, dispatching it first if it is
+ * still being queued.
+ */
+void
+GLAMOFenceWait(GlamoPtr pGlamo, unsigned long fence)
+{
+	if (GLAMOFenceRetired(pGlamo, fence))
+		return;
+
+	if ((long) (fence - pGlamo->fence) > 0)
+		GLAMOFlushCMDQCache(pGlamo, 1);
+
+	while (!GLAMOFenceRetired(pGlamo, fence))
+		;
+}
+
 MemBuf *
 GLAMOCreateCMDQCache(GlamoPtr pGlamo)
 {
@@ -326,6 +403,10 @@ GLAMODispatchCMDQCache(GlamoPtr pGlamo)
     if (!buf->used)
         return;
 
+	/* Make room to track the end of this batch. */
+	while (pGlamo->fence - pGlamo->fence_retired >= GLAMO_FENCE_RING)
+		GLAMOFenceUpdate(pGlamo);
+
     addr = ((char *)buf->address);
 	count = buf->used;
 	ring_count = pGlamo->ring_len;
@@ -390,8 +471,8 @@ GLAMODispatchCMDQCache(GlamoPtr pGlamo)
                 GLAMO_CLOCK_2D_EN_M6CLK,
 					0xffff);
     buf->used = 0;
-
-    GLAMOEngineWaitReal(pGlamo, GLAMO_ENGINE_ALL, FALSE);
+	pGlamo->fence++;
+	pGlamo->fence_end[pGlamo->fence % GLAMO_FENCE_RING] = new_ring_write;
 }
 
 void
@@ -442,10 +523,10 @@ GLAMOCMDQInit(GlamoPtr pGlamo,
 
 	pGlamo->ring_len = (cq_len + 1) * 1024;
 
+	if (pGlamo->exa_cmd_queue)
+		GLAMOVRAMFree(pGlamo, GLAMO_VRAM_CMDQ, pGlamo->exa_cmd_queue);
 	pGlamo->exa_cmd_queue =
-		exaOffscreenAlloc(pGlamo->pScreen, pGlamo->ring_len,
-				  pGlamo->exa->pixmapOffsetAlign,
-				  TRUE, NULL, NULL);
+		GLAMOVRAMAlloc(pGlamo, GLAMO_VRAM_CMDQ, pGlamo->ring_len);
 
 	if (!pGlamo->exa_cmd_queue)
 		return FALSE;
@@ -167,5 +167,11 @@ GLAMOEngineBusy(GlamoPtr pGlamo, enum GLAMOEngine engine);
 void
 GLAMOEngineWait(GlamoPtr pGlamo, enum GLAMOEngine engine);
 
+Bool
+GLAMOFenceRetired(GlamoPtr pGlamo, unsigned long fence);
+
+void
+GLAMOFenceWait(GlamoPtr pGlamo, unsigned long fence);
+
 #endif /* _GLAMO_DMA_H_ */
 
@@ -0,0 +1,327 @@
+/*
+ * Copyright  2007 OpenMoko, Inc.
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation, and
+ * that the name of the copyright holders not be used in advertising or
+ * publicity pertaining to distribution of the software without specific,
+ * written prior permission.  The copyright holders make no representations
+ * about the suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO
+ * EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE,
+ * DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER
+ * TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+ * OF THIS SOFTWARE.
+ */
+
+/*
+ * Hardware cursor.  The LCD controller lays an image of 2 bit pixels from
+ * VRAM over the scanout: transparent, or one of two colours.  Core cursors
+ * map onto it directly.  ARGB cursors are shown when they reduce to two
+ * colours and a mask, and are left to the software cursor underneath
+ * otherwise.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+#include "glamo.h"
+#include "glamo-regs.h"
+#include "xf86Cursor.h"
+#include "cursorstr.h"
+
+#define GLAMO_CURSOR_SIZE	64
+#define GLAMO_CURSOR_PITCH	(GLAMO_CURSOR_SIZE / 4)
+
+/* Pixels of the source and mask interleaved cursor image, source first. */
+static const CARD8 GlamoCursorCore[4] = {
+	GLAMO_CURSOR_TRANSPARENT,	/* no mask */
+	GLAMO_CURSOR_TRANSPARENT,
+	GLAMO_CURSOR_BG,		/* mask */
+	GLAMO_CURSOR_FG,		/* mask and source */
+};
+
+static CARD16
+GlamoCursorColor(CARD32 rgb)
+{
+	return ((rgb >> 8) & 0xf800) | ((rgb >> 5) & 0x07e0) |
+	       ((rgb >> 3) & 0x001f);
+}
+
+/* Colour of an ARGB cursor pixel shown without its alpha. */
+static CARD16
+GlamoCursorPixelColor(CARD32 argb)
+{
+	CARD32 a = argb >> 24, r, g, b;
+
+	if (a == 0xff)
+		return GlamoCursorColor(argb);
+
+	r = min(((argb >> 16) & 0xff) * 0xff / a, 0xff);
+	g = min(((argb >> 8) & 0xff) * 0xff / a, 0xff);
+	b = min((argb & 0xff) * 0xff / a, 0xff);
+
+	return GlamoCursorColor((r << 16) | (g << 8) | b);
+}
+
+/*
+ * Find the colours of an ARGB cursor.  Pixels at least half opaque are
+ * shown and the rest are transparent, which keeps the shape of cursors
+ * with antialiased edges.  Fails when more than two colours are shown.
+ */
+static Bool
+GlamoCursorReduce(const CARD32 *argb, int width, int height, int stride,
+		  CARD16 *fg, CARD16 *bg)
+{
+	CARD16 colors[2] = { 0, 0 };
+	int n = 0, x, y;
+
+	for (y = 0; y < height; y++, argb += stride) {
+		for (x = 0; x < width; x++) {
+			CARD16 color;
+
+			if ((argb[x] >> 24) < 0x80)
+				continue;
+
+			color = GlamoCursorPixelColor(argb[x]);
+			if ((n > 0 && color == colors[0]) ||
+			    (n > 1 && color == colors[1]))
+				continue;
+			if (n == 2)
+				return FALSE;
+			colors[n++] = color;
+		}
+	}
+
+	*fg = colors[0];
+	*bg = n > 1 ? colors[1] : colors[0];
+
+	return TRUE;
+}
+
+static Bool
+GlamoUseHWCursorARGB(ScreenPtr pScreen, CursorPtr pCurs)
+{
+	GlamoPtr pGlamo = GlamoPTR(xf86Screens[pScreen->myNum]);
+	CursorBitsPtr bits = pCurs->bits;
+	CARD16 fg, bg;
+
+	if (!pGlamo->UseHWCursorARGB(pScreen, pCurs))
+		return FALSE;
+
+	return GlamoCursorReduce(bits->argb, bits->width, bits->height,
+				 bits->width, &fg, &bg);
+}
+
+/*
+ * Point the LCD at the cursor image; it is always the largest size.  The
+ * LCD takes addresses from the start of VRAM, which is where the mapping
+ * begins, not the framebuffer the offscreen areas are counted from.
+ */
+static void
+GlamoCursorSetup(GlamoPtr pGlamo)
+{
+	volatile char *mmio = pGlamo->reg_base;
+	CARD32 offset = pGlamo->fboff + pGlamo->cursor_area->offset;
+
+	MMIO_OUT16(mmio, GLAMO_REG_LCD_CURSOR_BASE1, offset & 0xffff);
+	MMIO_OUT16(mmio, GLAMO_REG_LCD_CURSOR_BASE2, (offset >> 16) & 0x7f);
+	MMIO_OUT16(mmio, GLAMO_REG_LCD_CURSOR_PITCH, GLAMO_CURSOR_PITCH);
+	MMIO_OUT16(mmio, GLAMO_REG_LCD_CURSOR_X_SIZE, GLAMO_CURSOR_SIZE);
+	MMIO_OUT16(mmio, GLAMO_REG_LCD_CURSOR_Y_SIZE, GLAMO_CURSOR_SIZE);
+}
+
+static CARD16 *
+GlamoCursorImage(GlamoPtr pGlamo)
+{
+	return (CARD16 *)(pGlamo->fbstart + pGlamo->cursor_area->offset);
+}
+
+void
+GlamoCrtcSetCursorColors(xf86CrtcPtr crtc, int bg, int fg)
+{
+	GlamoPtr pGlamo = GlamoPTR(crtc->scrn);
+
+	MMIO_OUT16(pGlamo->reg_base, GLAMO_REG_LCD_CURSOR_FG_COLOR,
+		   GlamoCursorColor(fg));
+	MMIO_OUT16(pGlamo->reg_base, GLAMO_REG_LCD_CURSOR_BG_COLOR,
+		   GlamoCursorColor(bg));
+}
+
+/*
+ * The position is that of the preset pixel of the image, normally its top
+ * left corner.  Cursors hanging off the top or left of the screen keep it
+ * on the screen and move the preset into the image instead.
+ */
+void
+GlamoCrtcSetCursorPosition(xf86CrtcPtr crtc, int x, int y)
+{
+	GlamoPtr pGlamo = GlamoPTR(crtc->scrn);
+	int preset_x = 0, preset_y = 0;
+
+	if (x < 0) {
+		preset_x = -x;
+		x = 0;
+	}
+	if (y < 0) {
+		preset_y = -y;
+		y = 0;
+	}
+
+	MMIO_OUT16(pGlamo->reg_base, GLAMO_REG_LCD_CURSOR_PRESET,
+		   (preset_x << 8) | preset_y);
+	MMIO_OUT16(pGlamo->reg_base, GLAMO_REG_LCD_CURSOR_X_POS, x);
+	MMIO_OUT16(pGlamo->reg_base, GLAMO_REG_LCD_CURSOR_Y_POS, y);
+}
+
+void
+GlamoCrtcShowCursor(xf86CrtcPtr crtc)
+{
+	GlamoPtr pGlamo = GlamoPTR(crtc->scrn);
+
+	MMIOSetBitMask(pGlamo->reg_base, GLAMO_REG_LCD_MODE1,
+		       GLAMO_LCD_MODE1_CURSOR_EN |
+		       GLAMO_LCD_MODE1_CURSOR_DSTCOLOR,
+		       GLAMO_LCD_MODE1_CURSOR_EN);
+}
+
+void
+GlamoCrtcHideCursor(xf86CrtcPtr crtc)
+{
+	GlamoPtr pGlamo = GlamoPTR(crtc->scrn);
+
+	MMIOSetBitMask(pGlamo->reg_base, GLAMO_REG_LCD_MODE1,
+		       GLAMO_LCD_MODE1_CURSOR_EN, 0);
+}
+
+/*
+ * The image has the source and mask bits of each pixel next to each other
+ * from the LSB up, so each byte holds four pixels like the cursor does.
+ */
+void
+GlamoCrtcLoadCursorImage(xf86CrtcPtr crtc, CARD8 *image)
+{
+	GlamoPtr pGlamo = GlamoPTR(crtc->scrn);
+	CARD16 *dst = GlamoCursorImage(pGlamo);
+	int i, j;
+
+	for (i = 0; i < GLAMO_CURSOR_PITCH * GLAMO_CURSOR_SIZE / 2; i++) {
+		CARD16 bits = image[0] | (image[1] << 8);
+		CARD16 word = 0;
+
+		for (j = 0; j < 16; j += 2)
+			word |= GlamoCursorCore[(bits >> j) & 3] << j;
+		*dst++ = word;
+		image += 2;
+	}
+
+	GlamoCursorSetup(pGlamo);
+}
+
+void
+GlamoCrtcLoadCursorARGB(xf86CrtcPtr crtc, CARD32 *image)
+{
+	GlamoPtr pGlamo = GlamoPTR(crtc->scrn);
+	CARD16 *dst = GlamoCursorImage(pGlamo);
+	CARD16 fg, bg;
+	int i, j;
+
+	/* GlamoUseHWCursorARGB has made sure this fits. */
+	GlamoCursorReduce(image, GLAMO_CURSOR_SIZE, GLAMO_CURSOR_SIZE,
+			  GLAMO_CURSOR_SIZE, &fg, &bg);
+
+	for (i = 0; i < GLAMO_CURSOR_PITCH * GLAMO_CURSOR_SIZE / 2; i++) {
+		CARD16 word = 0;
+
+		for (j = 0; j < 16; j += 2) {
+			CARD32 argb = *image++;
+			CARD16 pixel;
+
+			if ((argb >> 24) < 0x80)
+				pixel = GLAMO_CURSOR_TRANSPARENT;
+			else if (GlamoCursorPixelColor(argb) == fg)
+				pixel = GLAMO_CURSOR_FG;
+			else
+				pixel = GLAMO_CURSOR_BG;
+			word |= pixel << j;
+		}
+		*dst++ = word;
+	}
+
+	MMIO_OUT16(pGlamo->reg_base, GLAMO_REG_LCD_CURSOR_FG_COLOR, fg);
+	MMIO_OUT16(pGlamo->reg_base, GLAMO_REG_LCD_CURSOR_BG_COLOR, bg);
+	GlamoCursorSetup(pGlamo);
+}
+
+/*
+ * Must be called after the software cursor is set up, which stays
+ * underneath for the cursors the LCD can't show.
+ */
+Bool
+GLAMOCursorInit(ScreenPtr pScreen)
+{
+	ScrnInfoPtr pScrn = xf86Screens[pScreen->myNum];
+	GlamoPtr pGlamo = GlamoPTR(pScrn);
+	xf86CrtcConfigPtr xf86_config = XF86_CRTC_CONFIG_PTR(pScrn);
+	xf86CursorInfoPtr cursor_info;
+
+	if (!pGlamo->reg_base) {
+		xf86DrvMsg(pScrn->scrnIndex, X_WARNING,
+			   "No hardware cursor: registers not mapped\n");
+		return FALSE;
+	}
+
+	/* The image lives in the offscreen memory EXA manages. */
+	if (!pGlamo->exa) {
+		xf86DrvMsg(pScrn->scrnIndex, X_WARNING,
+			   "No hardware cursor: no offscreen memory without "
+			   "acceleration\n");
+		return FALSE;
+	}
+
+	pGlamo->cursor_area = GLAMOVRAMAlloc(pGlamo, GLAMO_VRAM_CURSOR,
+					     GLAMO_CURSOR_PITCH *
+					     GLAMO_CURSOR_SIZE);
+	if (!pGlamo->cursor_area) {
+		xf86DrvMsg(pScrn->scrnIndex, X_WARNING,
+			   "No hardware cursor: no VRAM for its image\n");
+		return FALSE;
+	}
+
+	if (!xf86_cursors_init(pScreen, GLAMO_CURSOR_SIZE, GLAMO_CURSOR_SIZE,
+			       HARDWARE_CURSOR_AND_SOURCE_WITH_MASK |
+			       HARDWARE_CURSOR_SOURCE_MASK_INTERLEAVE_1 |
+			       HARDWARE_CURSOR_UPDATE_UNHIDDEN |
+			       HARDWARE_CURSOR_ARGB)) {
+		xf86DrvMsg(pScrn->scrnIndex, X_WARNING,
+			   "No hardware cursor: cursor layer setup failed\n");
+		GLAMOVRAMFree(pGlamo, GLAMO_VRAM_CURSOR, pGlamo->cursor_area);
+		pGlamo->cursor_area = NULL;
+		return FALSE;
+	}
+
+	cursor_info = xf86_config->cursor_info;
+	pGlamo->UseHWCursorARGB = cursor_info->UseHWCursorARGB;
+	cursor_info->UseHWCursorARGB = GlamoUseHWCursorARGB;
+
+	return TRUE;
+}
+
+void
+GLAMOCursorFini(ScreenPtr pScreen)
+{
+	GlamoPtr pGlamo = GlamoPTR(xf86Screens[pScreen->myNum]);
+
+	if (!pGlamo->cursor_area)
+		return;
+
+	xf86_cursors_fini(pScreen);
+	GLAMOVRAMFree(pGlamo, GLAMO_VRAM_CURSOR, pGlamo->cursor_area);
+	pGlamo->cursor_area = NULL;
+}
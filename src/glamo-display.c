@@ -71,12 +71,12 @@ static const xf86CrtcFuncsRec glamo_crtc_funcs = {
 	.shadow_allocate = NULL,
 	.shadow_create = NULL,
 	.shadow_destroy = NULL,
-	.set_cursor_colors = NULL,
-	.set_cursor_position = NULL,
-	.show_cursor = NULL,
-	.hide_cursor = NULL,
-	.load_cursor_image = NULL,
-	.load_cursor_argb = NULL,
+	.set_cursor_colors = GlamoCrtcSetCursorColors,
+	.set_cursor_position = GlamoCrtcSetCursorPosition,
+	.show_cursor = GlamoCrtcShowCursor,
+	.hide_cursor = GlamoCrtcHideCursor,
+	.load_cursor_image = GlamoCrtcLoadCursorImage,
+	.load_cursor_argb = GlamoCrtcLoadCursorARGB,
 	.destroy = GlamoCrtcDestroy,
 	.set_mode_major = GlamoSetModeMajor
 };
@@ -208,6 +208,10 @@ GlamoSetModeMajor(xf86CrtcPtr crtc, DisplayModePtr mode,
 	if (scrn->pScreen)
         xf86CrtcSetScreenSubpixelOrder (scrn->pScreen);
 
+    /* the framebuffer device may have reprogrammed the cursor registers */
+    if (pGlamo->cursor_area)
+        xf86_reload_cursors(scrn->pScreen);
+
 done:
 	if (!ret) {
 		crtc->x = saved_x;
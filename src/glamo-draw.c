@@ -26,13 +26,15 @@
 #ifdef HAVE_CONFIG_H
 #include <config.h>
 #endif
+#include <stdlib.h>
+#include <string.h>
 #include "glamo-log.h"
 #include "glamo.h"
 #include "glamo-regs.h"
 #include "glamo-cmdq.h"
 #include "glamo-draw.h"
 
-static const CARD8 GLAMOSolidRop[16] = {
+const CARD8 GLAMOSolidRop[16] = {
     /* GXclear      */      0x00,         /* 0 */
     /* GXand        */      0xa0,         /* src AND dst */
     /* GXandReverse */      0x50,         /* src AND NOT dst */
@@ -51,7 +53,7 @@ static const CARD8 GLAMOSolidRop[16] = {
     /* GXset        */      0xff,         /* 1 */
 };
 
-static const CARD8 GLAMOBltRop[16] = {
+const CARD8 GLAMOBltRop[16] = {
     /* GXclear      */      0x00,         /* 0 */
     /* GXand        */      0x88,         /* src AND dst */
     /* GXandReverse */      0x44,         /* src AND NOT dst */
@@ -74,18 +76,6 @@ static const CARD8 GLAMOBltRop[16] = {
  * exa entry points declarations
  ********************************/
 
-Bool
-GLAMOExaPrepareSolid(PixmapPtr      pPixmap,
-		     int            alu,
-		     Pixel          planemask,
-		     Pixel          fg);
-
-void
-GLAMOExaSolid(PixmapPtr pPixmap, int x1, int y1, int x2, int y2);
-
-void
-GLAMOExaDoneSolid(PixmapPtr pPixmap);
-
 void
 GLAMOExaCopy(PixmapPtr pDstPixmap,
 	     int    srcX,
@@ -145,6 +135,10 @@ GLAMOExaUploadToScreen(PixmapPtr pDst,
 		       int h,
 		       char *src,
 		       int src_pitch);
+
+static CARD32
+GLAMOExaUploadReserve(GlamoPtr pGlamo, int size);
+
 Bool
 GLAMOExaDownloadFromScreen(PixmapPtr pSrc,
 			   int x,  int y,
@@ -155,17 +149,253 @@ GLAMOExaDownloadFromScreen(PixmapPtr pSrc,
 void
 GLAMOExaWaitMarker (ScreenPtr pScreen, int marker);
 
+/* Milliseconds without requests before driver pixmaps are compacted */
+#define GLAMO_COMPACT_IDLE	200
+
 static void
 GLAMOBlockHandler(pointer blockData, OSTimePtr timeout, pointer readmask)
 {
 	ScreenPtr pScreen = (ScreenPtr) blockData;
+	ScrnInfoPtr pScrn = xf86Screens[pScreen->myNum];
 
 	exaWaitSync(pScreen);
+	GLAMOVRAMCompactDone(GlamoPTR(pScrn));
+	GLAMOStatsUpdate(GlamoPTR(pScrn));
+
+	/* Wake up to compact the pixmaps once the server has been idle. */
+	if (GlamoPTR(pScrn)->vram_fragmented)
+		AdjustWaitForDelay(timeout, GLAMO_COMPACT_IDLE);
 }
 
 static void
 GLAMOWakeupHandler(pointer blockData, int result, pointer readmask)
 {
+	ScreenPtr pScreen = (ScreenPtr) blockData;
+	GlamoPtr pGlamo = GlamoPTR(xf86Screens[pScreen->myNum]);
+
+	if (result == 0 && pGlamo->vram_fragmented && pGlamo->driver_pixmaps) {
+		GLAMOPixmapCompact(pGlamo);
+		GLAMOPixmapMigrate(pGlamo);
+	}
+}
+
+/* Crossover measurement, on a square of this side in the upload ring. */
+#define GLAMO_CALIBRATE_SIZE	32
+#define GLAMO_CALIBRATE_LOOPS	32
+
+static void
+GLAMOExaCPUFill(CARD8 *dst, int pitch, int w, int h, CARD16 fg)
+{
+	CARD16 *p;
+	int x;
+
+	for (; h; h--, dst += pitch)
+		for (x = 0, p = (CARD16 *) dst; x < w; x++)
+			p[x] = fg;
+}
+
+static void
+GLAMOExaCPUMove(CARD8 *dst, int dst_pitch, CARD8 *src, int src_pitch,
+		int w, int h)
+{
+	int y;
+
+	/* Bottom up when moving down within a pixmap. */
+	if (dst > src && dst < src + h * src_pitch) {
+		for (y = h - 1; y >= 0; y--)
+			memmove(dst + y * dst_pitch, src + y * src_pitch, w * 2);
+		return;
+	}
+
+	for (y = 0; y < h; y++)
+		memmove(dst + y * dst_pitch, src + y * src_pitch, w * 2);
+}
+
+/*
+ * Decide whether a box of the current solid or copy goes to the CPU.  Only
+ * GXcopy on idle 16bpp pixmaps qualifies, see GLAMOExaPrepareCPU.
+ */
+static Bool
+GLAMOExaUseCPU(GlamoPtr pGlamo, enum GLAMOCostOp op, int w, int h)
+{
+	GlamoCostPtr cost = &pGlamo->cost[op];
+
+	if (w * h > cost->cpu_max)
+		return FALSE;
+	if (!pGlamo->cpu_ok) {
+		cost->busy++;
+		return FALSE;
+	}
+
+	cost->cpu_boxes++;
+	cost->cpu_pixels += w * h;
+	return TRUE;
+}
+
+/*
+ * Called at the end of a solid or copy's setup, which took the last
+ * "words" command words.
+ */
+static void
+GLAMOExaPrepareCPU(GlamoPtr pGlamo, PixmapPtr pSrc, PixmapPtr pDst, int alu,
+		   int words)
+{
+	pGlamo->cpu_ok = pDst->drawable.bitsPerPixel == 16 && alu == GXcopy &&
+			 GLAMOPixmapIdle(pGlamo, pDst) &&
+			 (!pSrc || GLAMOPixmapIdle(pGlamo, pSrc));
+	pGlamo->cpu_dst = pGlamo->exa->memoryBase + GLAMOPixmapOffset(pDst);
+	pGlamo->cpu_dst_pitch = pDst->devKind;
+	if (pSrc) {
+		pGlamo->cpu_src = pGlamo->exa->memoryBase +
+				  GLAMOPixmapOffset(pSrc);
+		pGlamo->cpu_src_pitch = pSrc->devKind;
+	}
+
+	pGlamo->draw_blitted = FALSE;
+	pGlamo->cpu_setup_end = pGlamo->cmd_queue_cache->used;
+	pGlamo->cpu_setup_words = words;
+}
+
+/*
+ * When the CPU did all of a solid or copy, take its setup back out of the
+ * command cache so that nothing is sent and the pixmaps stay idle.
+ */
+static Bool
+GLAMOExaDropSetup(GlamoPtr pGlamo)
+{
+	MemBuf *buf = pGlamo->cmd_queue_cache;
+
+	if (pGlamo->draw_blitted || buf->used != pGlamo->cpu_setup_end ||
+	    buf->used < pGlamo->cpu_setup_words * 2)
+		return FALSE;
+
+	buf->used -= pGlamo->cpu_setup_words * 2;
+	return TRUE;
+}
+
+/* A solid or copy as GLAMOExaPrepareSolid/Copy and Done would send it. */
+static void
+GLAMOExaCalibrateBlit(GlamoPtr pGlamo, Bool copy, CARD32 src, CARD32 dst,
+		      int pitch, int w, int h)
+{
+	RING_LOCALS;
+
+	BEGIN_CMDQ(copy ? 34 : 26);
+	if (copy) {
+		OUT_REG(GLAMO_REG_2D_SRC_ADDRL, src & 0xffff);
+		OUT_REG(GLAMO_REG_2D_SRC_ADDRH, (src >> 16) & 0x7f);
+		OUT_REG(GLAMO_REG_2D_SRC_PITCH, pitch);
+	}
+	OUT_REG(GLAMO_REG_2D_DST_ADDRL, dst & 0xffff);
+	OUT_REG(GLAMO_REG_2D_DST_ADDRH, (dst >> 16) & 0x7f);
+	OUT_REG(GLAMO_REG_2D_DST_PITCH, pitch);
+	OUT_REG(GLAMO_REG_2D_DST_HEIGHT, h);
+	if (copy) {
+		OUT_REG(GLAMO_REG_2D_COMMAND2, GLAMOBltRop[GXcopy] << 8);
+	} else {
+		OUT_REG(GLAMO_REG_2D_PAT_FG, 0);
+		OUT_REG(GLAMO_REG_2D_COMMAND2, GLAMOSolidRop[GXcopy] << 8);
+	}
+	OUT_REG(GLAMO_REG_2D_ID1, 0);
+	OUT_REG(GLAMO_REG_2D_ID2, 0);
+	if (copy) {
+		OUT_REG(GLAMO_REG_2D_SRC_X, 0);
+		OUT_REG(GLAMO_REG_2D_SRC_Y, 0);
+	}
+	OUT_REG(GLAMO_REG_2D_DST_X, 0);
+	OUT_REG(GLAMO_REG_2D_DST_Y, 0);
+	OUT_REG(GLAMO_REG_2D_RECT_WIDTH, w);
+	OUT_REG(GLAMO_REG_2D_RECT_HEIGHT, h);
+	OUT_REG(GLAMO_REG_2D_COMMAND3, 0);
+	END_CMDQ();
+
+	/* Dispatching doesn't wait, and the blit is what is timed. */
+	GLAMOFlushCMDQCache(pGlamo, 1);
+	GLAMOEngineWait(pGlamo, GLAMO_ENGINE_ALL);
+}
+
+/* Microseconds taken by GLAMO_CALIBRATE_LOOPS solids or copies. */
+static double
+GLAMOExaCalibrateTime(GlamoPtr pGlamo, Bool cpu, Bool copy, int w, int h)
+{
+	int pitch = GLAMO_CALIBRATE_SIZE * 2;
+	CARD32 src = pGlamo->upload_area->offset;
+	CARD32 dst = src + pitch * GLAMO_CALIBRATE_SIZE;
+	CARD8 *base = pGlamo->exa->memoryBase;
+	struct timeval start, end;
+	int i;
+
+	gettimeofday(&start, NULL);
+	for (i = 0; i < GLAMO_CALIBRATE_LOOPS; i++) {
+		if (!cpu)
+			GLAMOExaCalibrateBlit(pGlamo, copy, src, dst, pitch,
+					      w, h);
+		else if (copy)
+			GLAMOExaCPUMove(base + dst, pitch, base + src, pitch,
+					w, h);
+		else
+			GLAMOExaCPUFill(base + dst, pitch, w, h, 0);
+	}
+	gettimeofday(&end, NULL);
+
+	return (end.tv_sec - start.tv_sec) * 1e6 +
+	       (end.tv_usec - start.tv_usec);
+}
+
+/*
+ * Measure the crossover below which the CPU is faster, modelling a blit
+ * as a fixed cost plus a cost per pixel and a CPU write as a cost per
+ * pixel only.  It is not extrapolated past the measured square.
+ */
+static void
+GLAMOExaCalibrate(GlamoPtr pGlamo)
+{
+	int scrnIndex = pGlamo->pScreen->myNum;
+	int n = GLAMO_CALIBRATE_SIZE * GLAMO_CALIBRATE_SIZE;
+	double blit_1, blit_n, cpu_n, per_pixel, fixed;
+	GlamoCostPtr cost;
+	const char *name;
+	Bool copy;
+	int op;
+
+	for (op = 0; op < NB_GLAMO_COST_OPS; op++) {
+		cost = &pGlamo->cost[op];
+		copy = op == GLAMO_COST_COPY;
+		name = copy ? "copies" : "solids";
+		if (cost->cpu_max >= 0) {
+			xf86DrvMsg(scrnIndex, X_CONFIG, "CPU %s: up to %d "
+				   "pixels\n", name, cost->cpu_max);
+			continue;
+		}
+		if (!pGlamo->upload_area) {
+			cost->cpu_max = 0;
+			continue;
+		}
+
+		blit_1 = GLAMOExaCalibrateTime(pGlamo, FALSE, copy, 1, 1);
+		blit_n = GLAMOExaCalibrateTime(pGlamo, FALSE, copy,
+					       GLAMO_CALIBRATE_SIZE,
+					       GLAMO_CALIBRATE_SIZE);
+		cpu_n = GLAMOExaCalibrateTime(pGlamo, TRUE, copy,
+					      GLAMO_CALIBRATE_SIZE,
+					      GLAMO_CALIBRATE_SIZE);
+
+		per_pixel = (blit_n - blit_1) / (n - 1);
+		fixed = blit_1 - per_pixel;
+		if (cpu_n / n <= per_pixel)
+			cost->cpu_max = n;
+		else
+			cost->cpu_max = min(n, fixed / (cpu_n / n - per_pixel));
+		if (cost->cpu_max < 0)
+			cost->cpu_max = 0;
+
+		xf86DrvMsg(scrnIndex, X_INFO, "Blitter %s: %.1f us + %.3f us "
+			   "per pixel, CPU: %.3f us per pixel; CPU %s: up to "
+			   "%d pixels\n", name, fixed / GLAMO_CALIBRATE_LOOPS,
+			   per_pixel / GLAMO_CALIBRATE_LOOPS,
+			   cpu_n / n / GLAMO_CALIBRATE_LOOPS, name,
+			   cost->cpu_max);
+	}
 }
 
 void
@@ -179,8 +409,19 @@ void
 GLAMODrawEnable(GlamoPtr pGlamo)
 {
 	GLAMOCMDQCacheSetup(pGlamo);
+	GLAMOMonoCacheInit(pGlamo);
+	GLAMOExaUploadRingInit(pGlamo);
 	GLAMODrawSetup(pGlamo);
+	if (pGlamo->hw_clip) {
+		/* Force all four registers to be written. */
+		pGlamo->hw_clip_box.x1 = pGlamo->hw_clip_box.y1 = -1;
+		pGlamo->hw_clip_box.x2 = pGlamo->hw_clip_box.y2 = -1;
+		GLAMOExaResetClip(pGlamo);
+		GLAMOFlushCMDQCache(pGlamo, 1);
+	}
 	GLAMOEngineWait(pGlamo, GLAMO_ENGINE_ALL);
+	GLAMOExaCalibrate(pGlamo);
+	GLAMOVRAMReport(pGlamo);
 }
 
 Bool
@@ -198,9 +439,6 @@ GLAMODrawExaInit(ScreenPtr pScreen, ScrnInfoPtr pScrn)
     if(!exa) return FALSE;
 
 	exa->memoryBase = pGlamo->fbstart;
-	exa->memorySize = 1024 * 1024 * 4;
-	/*exa->offScreenBase = pGlamo->fboff;*/
-	exa->offScreenBase = pScrn->virtualX * pScrn->virtualY * 2;
 
 	exa->exa_major = 2;
 	exa->exa_minor = 0;
@@ -228,17 +466,44 @@ GLAMODrawExaInit(ScreenPtr pScreen, ScrnInfoPtr pScrn)
 	exa->pixmapOffsetAlign = 2;
 	exa->pixmapPitchAlign = 2;
 
-	exa->maxX = 640;
-	exa->maxY = 640;
+	if (!GLAMOVRAMInit(pScrn, exa)) {
+		xfree(exa);
+		pGlamo->exa = NULL;
+		return FALSE;
+	}
+
+	exa->maxX = GLAMO_MAX_PIXMAP_SIZE;
+	exa->maxY = GLAMO_MAX_PIXMAP_SIZE;
 
 	exa->flags = EXA_OFFSCREEN_PIXMAPS;
 
+	if (pGlamo->driver_pixmaps) {
+		exa->flags |= EXA_HANDLES_PIXMAPS;
+		exa->CreatePixmap = GLAMOExaCreatePixmap;
+		exa->DestroyPixmap = GLAMOExaDestroyPixmap;
+		exa->ModifyPixmapHeader = GLAMOExaModifyPixmapHeader;
+		exa->PrepareAccess = GLAMOExaPrepareAccess;
+		exa->FinishAccess = GLAMOExaFinishAccess;
+		exa->PixmapIsOffscreen = GLAMOExaPixmapIsOffscreen;
+		GLAMOPixmapInit(pGlamo);
+	}
+#ifdef EXA_SUPPORTS_OFFSCREEN_OVERLAPS
+	/* Lets EXA compact the offscreen heap with the blitter. */
+	exa->flags |= EXA_SUPPORTS_OFFSCREEN_OVERLAPS;
+#endif
+
+	GLAMOTransferInit(pScrn);
+	GLAMOBlendInit(pScrn);
+
 	RegisterBlockAndWakeupHandlers(GLAMOBlockHandler,
 				       GLAMOWakeupHandler,
 				       pScreen);
 
 	success = exaDriverInit(pScreen, exa);
 	if (success) {
+		if (!GLAMOGCInit(pScreen))
+			xf86DrvMsg(pScrn->scrnIndex, X_WARNING,
+				   "Text acceleration not available\n");
 		ErrorF("Initialized EXA acceleration\n");
 	} else {
 		ErrorF("Failed to initialize EXA acceleration\n");
@@ -247,30 +512,292 @@ GLAMODrawExaInit(ScreenPtr pScreen, ScrnInfoPtr pScrn)
 	return success;
 }
 
-Bool
-GLAMOExaPrepareSolid(PixmapPtr      pPix,
-		     int            alu,
-		     Pixel          pm,
-		     Pixel          fg)
+void
+GLAMODrawFini(ScreenPtr pScreen)
 {
-	ScrnInfoPtr pScrn = xf86Screens[pPix->drawable.pScreen->myNum];
+	ScrnInfoPtr pScrn = xf86Screens[pScreen->myNum];
 	GlamoPtr pGlamo = GlamoPTR(pScrn);
 
+	if (!pGlamo->exa)
+		return;
+
+	GLAMOStatsReport(pGlamo);
+	pGlamo->stats_output = NULL;
+	xf86DrvMsg(pScrn->scrnIndex, X_INFO,
+		   "Mono cache hits: %lu, misses: %lu\n",
+		   pGlamo->mono_cache.hits, pGlamo->mono_cache.misses);
+	xf86DrvMsg(pScrn->scrnIndex, X_INFO,
+		   "Uploads staged: %lu, direct: %lu, ring wraps: %lu\n",
+		   pGlamo->upload_staged, pGlamo->upload_direct,
+		   pGlamo->upload_wraps);
+	if (pGlamo->copy_bounced)
+		xf86DrvMsg(pScrn->scrnIndex, X_INFO,
+			   "Shifted copies bounced through the staging ring: "
+			   "%lu\n", pGlamo->copy_bounced);
+	if (pGlamo->hw_clip_requests)
+		xf86DrvMsg(pScrn->scrnIndex, X_INFO,
+			   "Hardware clipping saved %ld command words in %lu "
+			   "requests (%ld per request)\n",
+			   pGlamo->hw_clip_words_saved,
+			   pGlamo->hw_clip_requests,
+			   pGlamo->hw_clip_words_saved /
+			   (long) pGlamo->hw_clip_requests);
+
+	if (pGlamo->vram_compactions)
+		xf86DrvMsg(pScrn->scrnIndex, X_INFO,
+			   "Offscreen memory compacted %lu times, "
+			   "%lu areas moved\n",
+			   pGlamo->vram_compactions, pGlamo->vram_moves);
+
+	if (pGlamo->split_pieces)
+		xf86DrvMsg(pScrn->scrnIndex, X_INFO,
+			   "Blits split for large pixmaps: %lu pieces\n",
+			   pGlamo->split_pieces);
+
+	if (pGlamo->driver_pixmaps)
+		GLAMOPixmapFini(pGlamo);
+	GLAMOGCFini(pScreen);
+	GLAMOMonoCacheFini(pGlamo);
+	if (pGlamo->upload_area) {
+		GLAMOVRAMFree(pGlamo, GLAMO_VRAM_UPLOAD, pGlamo->upload_area);
+		pGlamo->upload_area = NULL;
+	}
+
+	RemoveBlockAndWakeupHandlers(GLAMOBlockHandler,
+				     GLAMOWakeupHandler,
+				     pScreen);
+
+	GLAMOCMQCacheTeardown(pGlamo);
+	exaDriverFini(pScreen);
+	xfree(pGlamo->exa);
+	pGlamo->exa = NULL;
+}
+
+/* 8bpp pixmaps are drawn as 16bpp ones of half the width. */
+Bool
+GLAMOPixmapIsLarge(PixmapPtr pPix)
+{
+	int width = (pPix->drawable.width * pPix->drawable.bitsPerPixel + 15) / 16;
+
+	return pPix->devKind > GLAMO_HW_MAX_PITCH ||
+	       width > GLAMO_HW_MAX_COORD ||
+	       pPix->drawable.height > GLAMO_HW_MAX_COORD;
+}
+
+static CARD8
+GLAMOByteRop(int alu, CARD8 src, CARD8 dst)
+{
+	switch (alu) {
+	case GXclear:		return 0;
+	case GXand:		return src & dst;
+	case GXandReverse:	return src & ~dst;
+	case GXcopy:		return src;
+	case GXandInverted:	return ~src & dst;
+	case GXnoop:		return dst;
+	case GXxor:		return src ^ dst;
+	case GXor:		return src | dst;
+	case GXnor:		return ~(src | dst);
+	case GXequiv:		return ~src ^ dst;
+	case GXinvert:		return ~dst;
+	case GXorReverse:	return src | ~dst;
+	case GXcopyInverted:	return ~src;
+	case GXorInverted:	return ~src | dst;
+	case GXnand:		return ~(src & dst);
+	case GXset:
+	default:		return 0xff;
+	}
+}
+
+/*
+ * Draw the queued parts of an 8bpp solid or copy with the CPU, once the
+ * blits queued before them have landed.  Rows and bytes are walked in the
+ * order that reads the source before it is overwritten, so rectangles
+ * may overlap their own source.
+ */
+static void
+GLAMOExaFlushByteRects(GlamoPtr pGlamo)
+{
+	GlamoByteRectPtr r;
+	CARD8 *src, *dst;
+	int i, x, y, row;
+
+	if (!pGlamo->byte_nrect)
+		return;
+
+	GLAMOEngineWait(pGlamo, GLAMO_ENGINE_ALL);
+
+	for (i = 0, r = pGlamo->byte_rects; i < pGlamo->byte_nrect; i++, r++) {
+		for (y = 0; y < r->h; y++) {
+			row = r->dy > r->sy ? r->h - 1 - y : y;
+			dst = pGlamo->byte_dst + (r->dy + row) *
+			      pGlamo->byte_dst_pitch + r->dx;
+
+			if (!pGlamo->byte_src) {
+				for (x = 0; x < r->w; x++)
+					dst[x] = GLAMOByteRop(pGlamo->byte_alu,
+							      pGlamo->byte_fg,
+							      dst[x]);
+				continue;
+			}
+
+			src = pGlamo->byte_src + (r->sy + row) *
+			      pGlamo->byte_src_pitch + r->sx;
+			if (pGlamo->byte_alu == GXcopy)
+				memmove(dst, src, r->w);
+			else if (dst > src)
+				for (x = r->w - 1; x >= 0; x--)
+					dst[x] = GLAMOByteRop(pGlamo->byte_alu,
+							      src[x], dst[x]);
+			else
+				for (x = 0; x < r->w; x++)
+					dst[x] = GLAMOByteRop(pGlamo->byte_alu,
+							      src[x], dst[x]);
+		}
+	}
+
+	pGlamo->byte_nrect = 0;
+}
+
+static void
+GLAMOExaQueueByteRect(GlamoPtr pGlamo, int sx, int sy, int dx, int dy,
+		      int w, int h)
+{
+	GlamoByteRectPtr r;
+
+	if (pGlamo->byte_nrect == GLAMO_BYTE_RECTS)
+		GLAMOExaFlushByteRects(pGlamo);
+
+	r = &pGlamo->byte_rects[pGlamo->byte_nrect++];
+	r->sx = sx;
+	r->sy = sy;
+	r->dx = dx;
+	r->dy = dy;
+	r->w = w;
+	r->h = h;
+}
+
+/*
+ * Set up an 8bpp solid or copy.  Pixel pairs starting on an even byte
+ * are blitted as 16bpp pixels, which needs even offsets and pitches.
+ */
+static Bool
+GLAMOExaPrepareBytes(GlamoPtr pGlamo, PixmapPtr pSrc, PixmapPtr pDst,
+		     int alu, Pixel fg)
+{
+	CARD32 dst_offset = GLAMOPixmapOffset(pDst);
+	CARD32 src_offset = pSrc ? GLAMOPixmapOffset(pSrc) : 0;
+	int src_pitch = pSrc ? pSrc->devKind : 0;
+
+	if ((dst_offset | pDst->devKind | src_offset | src_pitch) & 1)
+		return FALSE;
+
+	pGlamo->draw_bytes = TRUE;
+	pGlamo->byte_alu = alu;
+	pGlamo->byte_fg = fg;
+	pGlamo->byte_dst = pGlamo->exa->memoryBase + dst_offset;
+	pGlamo->byte_dst_pitch = pDst->devKind;
+	pGlamo->byte_src = pSrc ? pGlamo->exa->memoryBase + src_offset : NULL;
+	pGlamo->byte_src_pitch = src_pitch;
+	pGlamo->byte_nrect = 0;
+
+	return TRUE;
+}
+
+/*
+ * Draw a rectangle involving a pixmap the 2D engine can't address as a
+ * whole, in pieces of at most GLAMO_HW_MAX_COORD pixels on a side.  Each
+ * piece gets the base addresses moved to its top left corner, so the
+ * engine only ever sees small coordinates.  No piece, however narrow,
+ * gets around a pitch too large for the register, so pixmaps with one
+ * are left to software before getting here.
+ */
+static void
+GLAMOExaSplitBlt(GlamoPtr pGlamo,
+		 Bool copy,
+		 int srcX,
+		 int srcY,
+		 int dstX,
+		 int dstY,
+		 int width,
+		 int height)
+{
+	GlamoSurfacePtr src = &pGlamo->split_src;
+	GlamoSurfacePtr dst = &pGlamo->split_dst;
+	int x, y, w, h;
+	CARD32 offset;
+	RING_LOCALS;
+
+	for (y = 0; y < height; y += h) {
+		h = min(GLAMO_HW_MAX_COORD, height - y);
+		for (x = 0; x < width; x += w) {
+			w = min(GLAMO_HW_MAX_COORD, width - x);
+
+			if (copy) {
+				offset = src->offset + (srcY + y) * src->pitch +
+					 (srcX + x) * 2;
+				GLAMOExaSetSrc(pGlamo, offset, src->pitch);
+			}
+
+			offset = dst->offset + (dstY + y) * dst->pitch +
+				 (dstX + x) * 2;
+
+			BEGIN_CMDQ(copy ? 22 : 18);
+			OUT_REG(GLAMO_REG_2D_DST_ADDRL, offset & 0xffff);
+			OUT_REG(GLAMO_REG_2D_DST_ADDRH, (offset >> 16) & 0x7f);
+			OUT_REG(GLAMO_REG_2D_DST_PITCH, dst->pitch);
+			OUT_REG(GLAMO_REG_2D_DST_HEIGHT, h);
+			if (copy) {
+				OUT_REG(GLAMO_REG_2D_SRC_X, 0);
+				OUT_REG(GLAMO_REG_2D_SRC_Y, 0);
+			}
+			OUT_REG(GLAMO_REG_2D_DST_X, 0);
+			OUT_REG(GLAMO_REG_2D_DST_Y, 0);
+			OUT_REG(GLAMO_REG_2D_RECT_WIDTH, w);
+			OUT_REG(GLAMO_REG_2D_RECT_HEIGHT, h);
+			OUT_REG(GLAMO_REG_2D_COMMAND3, 0);
+			END_CMDQ();
+
+			pGlamo->split_pieces++;
+		}
+	}
+}
+
+/*
+ * The solid, copy and composite hooks are split into setting up, queueing
+ * and finishing the operation, which composite shares, and the counting
+ * in the statistics of the operation EXA asked for.
+ */
+static Bool
+GLAMOExaSetupSolid(GlamoPtr pGlamo, PixmapPtr pPix, int alu, Pixel pm,
+		   Pixel fg)
+{
 	CARD32 offset;
     CARD16 op, pitch;
 	FbBits mask;
+	int bpp = pPix->drawable.bitsPerPixel;
 	RING_LOCALS;
 
-	if (pPix->drawable.bitsPerPixel != 16)
-		GLAMO_FALLBACK(("Only 16bpp is supported\n"));
+	if (bpp != 16 && bpp != 8)
+		GLAMO_FALLBACK(pGlamo, GLAMO_FALLBACK_BPP);
 
-	mask = FbFullMask(16);
+	mask = FbFullMask(bpp);
 	if ((pm & mask) != mask)
-		GLAMO_FALLBACK(("Can't do planemask 0x%08x\n",
-				(unsigned int) pm));
+		GLAMO_FALLBACK(pGlamo, GLAMO_FALLBACK_PLANEMASK);
+
+	if (pPix->devKind > GLAMO_HW_MAX_PITCH)
+		GLAMO_FALLBACK(pGlamo, GLAMO_FALLBACK_PITCH);
+
+	pGlamo->draw_bytes = FALSE;
+	pGlamo->solid_gxcopy = (alu == GXcopy);
+	pGlamo->solid_fg = fg & mask;
+	if (bpp == 8) {
+		if (!GLAMOExaPrepareBytes(pGlamo, NULL, pPix, alu, fg))
+			GLAMO_FALLBACK(pGlamo, GLAMO_FALLBACK_BYTE_ALIGN);
+		fg = (fg & 0xff) * 0x0101;
+	}
 
 	op = GLAMOSolidRop[alu] << 8;
-	offset = exaGetPixmapOffset(pPix);
+	offset = GLAMOPixmapOffset(pPix);
 	pitch = pPix->devKind;
 
 	BEGIN_CMDQ(16);
@@ -283,48 +810,344 @@ GLAMOExaPrepareSolid(PixmapPtr      pPix,
 	OUT_REG(GLAMO_REG_2D_ID1, 0);
 	OUT_REG(GLAMO_REG_2D_ID2, 0);
 	END_CMDQ();
+	GLAMOExaResetClip(pGlamo);
+
+	GLAMOExaPrepareCPU(pGlamo, NULL, pPix, alu, 16);
+	pGlamo->cpu_fg = fg;
+	pGlamo->solid_nbox = 0;
+	pGlamo->solid_split = GLAMOPixmapIsLarge(pPix);
+	pGlamo->split_dst.offset = offset;
+	pGlamo->split_dst.pitch = pitch;
 
 	return TRUE;
 }
 
-void
-GLAMOExaSolid(PixmapPtr pPix, int x1, int y1, int x2, int y2)
+Bool
+GLAMOExaPrepareSolid(PixmapPtr      pPix,
+		     int            alu,
+		     Pixel          pm,
+		     Pixel          fg)
 {
 	ScrnInfoPtr pScrn = xf86Screens[pPix->drawable.pScreen->myNum];
 	GlamoPtr pGlamo = GlamoPTR(pScrn);
 
+	if (GLAMOShadowIsScreen(pGlamo, pPix))
+		GLAMO_FALLBACK(pGlamo, GLAMO_FALLBACK_SHADOW);
+
+	if (!GLAMOExaSetupSolid(pGlamo, pPix, alu, pm, fg))
+		return FALSE;
+
+	GLAMOStatBegin(pGlamo, GLAMO_STAT_SOLID);
+	return TRUE;
+}
+
+static int
+GLAMOBoxCompareColumns(const void *a, const void *b)
+{
+	const BoxRec *p = a, *q = b;
+
+	if (p->x1 != q->x1)
+		return p->x1 - q->x1;
+	if (p->x2 != q->x2)
+		return p->x2 - q->x2;
+	return p->y1 - q->y1;
+}
+
+static int
+GLAMOBoxCompareRows(const void *a, const void *b)
+{
+	const BoxRec *p = a, *q = b;
+
+	if (p->y1 != q->y1)
+		return p->y1 - q->y1;
+	if (p->y2 != q->y2)
+		return p->y2 - q->y2;
+	return p->x1 - q->x1;
+}
+
+/*
+ * Merge the queued solid boxes which share a whole edge.  All of them are
+ * filled with the same colour and raster op, so the order they are drawn
+ * in doesn't matter.  Sorting on the columns brings the pieces of a box
+ * split into bands by a region together, and sorting on the rows then
+ * those side by side.  Returns the number of boxes left.
+ */
+static int
+GLAMOExaMergeSolid(GlamoPtr pGlamo)
+{
+	BoxPtr boxes = pGlamo->solid_boxes;
+	int i, m, n = pGlamo->solid_nbox;
+
+	if (n < 2)
+		return n;
+
+	qsort(boxes, n, sizeof(BoxRec), GLAMOBoxCompareColumns);
+	for (i = 1, m = 0; i < n; i++) {
+		if (boxes[i].x1 == boxes[m].x1 && boxes[i].x2 == boxes[m].x2 &&
+		    boxes[i].y1 == boxes[m].y2)
+			boxes[m].y2 = boxes[i].y2;
+		else
+			boxes[++m] = boxes[i];
+	}
+	n = m + 1;
+
+	qsort(boxes, n, sizeof(BoxRec), GLAMOBoxCompareRows);
+	for (i = 1, m = 0; i < n; i++) {
+		if (boxes[i].y1 == boxes[m].y1 && boxes[i].y2 == boxes[m].y2 &&
+		    boxes[i].x1 == boxes[m].x2)
+			boxes[m].x2 = boxes[i].x2;
+		else
+			boxes[++m] = boxes[i];
+	}
+	n = m + 1;
+
+	pGlamo->solid_merged += pGlamo->solid_nbox - n;
+	return n;
+}
+
+/* Count the edges of the clip rectangle which differ from the box. */
+static int
+GLAMOClipEdges(BoxPtr clip, const BoxRec *box)
+{
+	int n = (clip->x1 != box->x1) + (clip->y1 != box->y1) +
+		(clip->x2 != box->x2) + (clip->y2 != box->y2);
+
+	*clip = *box;
+	return n;
+}
+
+/*
+ * Command words needed to kick one blit per box over the extents of all
+ * of them, clipped to each box in turn, and to open the clip again
+ * afterwards.  The extents are returned; programming them is left to the
+ * caller.
+ */
+static int
+GLAMOExaClipCost(GlamoPtr pGlamo, BoxPtr boxes, int n, BoxPtr extents)
+{
+	BoxRec clip = pGlamo->hw_clip_box;
+	BoxRec open = { 0, 0, GLAMO_HW_CLIP_MAX, GLAMO_HW_CLIP_MAX };
+	int i, words = 0;
+
+	*extents = boxes[0];
+	for (i = 0; i < n; i++) {
+		words += 2 * GLAMOClipEdges(&clip, &boxes[i]) + 2;
+		extents->x1 = min(extents->x1, boxes[i].x1);
+		extents->y1 = min(extents->y1, boxes[i].y1);
+		extents->x2 = max(extents->x2, boxes[i].x2);
+		extents->y2 = max(extents->y2, boxes[i].y2);
+	}
+
+	return words + 2 * GLAMOClipEdges(&clip, &open);
+}
+
+/* Kick the blit set up over the extents once for each box, clipped to it. */
+static int
+GLAMOExaEmitClipped(GlamoPtr pGlamo, BoxPtr boxes, int n)
+{
+	int i, words = 0;
 	RING_LOCALS;
 
-	BEGIN_CMDQ(10);
-	OUT_REG(GLAMO_REG_2D_DST_X, x1);
-	OUT_REG(GLAMO_REG_2D_DST_Y, y1);
-	OUT_REG(GLAMO_REG_2D_RECT_WIDTH, x2 - x1);
-	OUT_REG(GLAMO_REG_2D_RECT_HEIGHT, y2 - y1);
-	OUT_REG(GLAMO_REG_2D_COMMAND3, 0);
+	for (i = 0; i < n; i++) {
+		words += GLAMOExaSetClip(pGlamo, boxes[i].x1, boxes[i].y1,
+					 boxes[i].x2, boxes[i].y2);
+		BEGIN_CMDQ(2);
+		OUT_REG(GLAMO_REG_2D_COMMAND3, 0);
+		END_CMDQ();
+		words += 2;
+	}
+
+	return words + GLAMOExaResetClip(pGlamo);
+}
+
+/*
+ * Emit the queued solid fill rectangles.  The destination registers keep
+ * their value between two kicks, so only the coordinates that differ from
+ * the previous rectangle are written.  Rows and columns of equally sized
+ * rectangles (grids, list views) then cost three register writes each
+ * instead of five.  Scattered rectangles are cheaper as one fill over
+ * their extents clipped to each of them, when the clip is enabled.
+ */
+static void
+GLAMOExaFlushSolid(GlamoPtr pGlamo)
+{
+	BoxPtr box;
+	BoxRec extents;
+	int i, n, x, y, w, h, clip;
+	RING_LOCALS;
+
+	if (!pGlamo->solid_nbox)
+		return;
+
+	pGlamo->solid_nbox = GLAMOExaMergeSolid(pGlamo);
+
+	if (pGlamo->solid_split) {
+		for (i = 0, box = pGlamo->solid_boxes; i < pGlamo->solid_nbox;
+		     i++, box++)
+			GLAMOExaSplitBlt(pGlamo, FALSE, 0, 0, box->x1, box->y1,
+					 box->x2 - box->x1, box->y2 - box->y1);
+		pGlamo->solid_nbox = 0;
+		return;
+	}
+
+	/* First pass: count the words, second pass: emit them. */
+	n = 0;
+	x = y = w = h = -1;
+	for (i = 0, box = pGlamo->solid_boxes; i < pGlamo->solid_nbox;
+	     i++, box++) {
+		if (box->x1 != x)
+			n += 2;
+		if (box->y1 != y)
+			n += 2;
+		if (box->x2 - box->x1 != w)
+			n += 2;
+		if (box->y2 - box->y1 != h)
+			n += 2;
+		n += 2;
+		x = box->x1;
+		y = box->y1;
+		w = box->x2 - box->x1;
+		h = box->y2 - box->y1;
+	}
+
+	if (pGlamo->hw_clip && pGlamo->solid_nbox > 1) {
+		clip = 8 + GLAMOExaClipCost(pGlamo, pGlamo->solid_boxes,
+					    pGlamo->solid_nbox, &extents);
+		if (clip < n) {
+			BEGIN_CMDQ(8);
+			OUT_REG(GLAMO_REG_2D_DST_X, extents.x1);
+			OUT_REG(GLAMO_REG_2D_DST_Y, extents.y1);
+			OUT_REG(GLAMO_REG_2D_RECT_WIDTH,
+				extents.x2 - extents.x1);
+			OUT_REG(GLAMO_REG_2D_RECT_HEIGHT,
+				extents.y2 - extents.y1);
+			END_CMDQ();
+			GLAMOExaEmitClipped(pGlamo, pGlamo->solid_boxes,
+					    pGlamo->solid_nbox);
+			pGlamo->hw_clip_words_saved += n - clip;
+			pGlamo->hw_clip_requests++;
+			pGlamo->solid_nbox = 0;
+			return;
+		}
+	}
+
+	BEGIN_CMDQ(n);
+	x = y = w = h = -1;
+	for (i = 0, box = pGlamo->solid_boxes; i < pGlamo->solid_nbox;
+	     i++, box++) {
+		if (box->x1 != x) {
+			x = box->x1;
+			OUT_REG(GLAMO_REG_2D_DST_X, x);
+		}
+		if (box->y1 != y) {
+			y = box->y1;
+			OUT_REG(GLAMO_REG_2D_DST_Y, y);
+		}
+		if (box->x2 - box->x1 != w) {
+			w = box->x2 - box->x1;
+			OUT_REG(GLAMO_REG_2D_RECT_WIDTH, w);
+		}
+		if (box->y2 - box->y1 != h) {
+			h = box->y2 - box->y1;
+			OUT_REG(GLAMO_REG_2D_RECT_HEIGHT, h);
+		}
+		OUT_REG(GLAMO_REG_2D_COMMAND3, 0);
+	}
 	END_CMDQ();
+
+	pGlamo->solid_nbox = 0;
+}
+
+static void
+GLAMOExaQueueSolid(GlamoPtr pGlamo, PixmapPtr pPix, int x1, int y1, int x2,
+		   int y2)
+{
+	BoxPtr box;
+	Pixel color;
+
+	/* Filling a pixmap with the colour it already is all of */
+	if (pGlamo->solid_gxcopy && GLAMOPixmapIsSolid(pGlamo, pPix, &color) &&
+	    color == pGlamo->solid_fg) {
+		pGlamo->solid_fills_dropped++;
+		return;
+	}
+
+	GLAMOPixmapDirty(pGlamo, pPix, x1, y1, x2, y2);
+	if (pGlamo->solid_gxcopy && x1 <= 0 && y1 <= 0 &&
+	    x2 >= pPix->drawable.width && y2 >= pPix->drawable.height)
+		GLAMOPixmapSolid(pGlamo, pPix, TRUE, pGlamo->solid_fg);
+
+	if (!pGlamo->draw_bytes &&
+	    GLAMOExaUseCPU(pGlamo, GLAMO_COST_SOLID, x2 - x1, y2 - y1)) {
+		GLAMOExaCPUFill(pGlamo->cpu_dst + y1 * pGlamo->cpu_dst_pitch +
+				x1 * 2, pGlamo->cpu_dst_pitch, x2 - x1,
+				y2 - y1, pGlamo->cpu_fg);
+		return;
+	}
+	pGlamo->draw_blitted = TRUE;
+
+	if (pGlamo->solid_nbox == GLAMO_SOLID_BATCH_SIZE)
+		GLAMOExaFlushSolid(pGlamo);
+
+	/* Odd columns at the edges go to the CPU, pairs to the blitter. */
+	if (pGlamo->draw_bytes) {
+		if (x1 & 1)
+			GLAMOExaQueueByteRect(pGlamo, 0, 0, x1, y1, 1, y2 - y1);
+		if (x2 & 1)
+			GLAMOExaQueueByteRect(pGlamo, 0, 0, x2 - 1, y1,
+					      1, y2 - y1);
+		x1 = (x1 + 1) / 2;
+		x2 = x2 / 2;
+		if (x1 >= x2)
+			return;
+		if (pGlamo->solid_nbox == GLAMO_SOLID_BATCH_SIZE)
+			GLAMOExaFlushSolid(pGlamo);
+	}
+
+	box = &pGlamo->solid_boxes[pGlamo->solid_nbox++];
+	box->x1 = x1;
+	box->y1 = y1;
+	box->x2 = x2;
+	box->y2 = y2;
 }
 
 void
-GLAMOExaDoneSolid(PixmapPtr pPix)
+GLAMOExaSolid(PixmapPtr pPix, int x1, int y1, int x2, int y2)
 {
 	ScrnInfoPtr pScrn = xf86Screens[pPix->drawable.pScreen->myNum];
 	GlamoPtr pGlamo = GlamoPTR(pScrn);
 
+	pGlamo->stats[GLAMO_STAT_SOLID].pixels += (x2 - x1) * (y2 - y1);
+	GLAMOExaQueueSolid(pGlamo, pPix, x1, y1, x2, y2);
+}
+
+/* Emit what is queued and get it going. */
+static void
+GLAMOExaFinishSolid(GlamoPtr pGlamo, PixmapPtr pPix)
+{
+	GLAMOExaFlushSolid(pGlamo);
+	GLAMOExaFlushByteRects(pGlamo);
+	if (!GLAMOExaDropSetup(pGlamo))
+		GLAMOPixmapFence(pGlamo, pPix);
+
     GLAMOFlushCMDQCache(pGlamo, 1);
 	exaMarkSync(pGlamo->pScreen);
 }
 
-Bool
-GLAMOExaPrepareCopy(PixmapPtr       pSrc,
-		    PixmapPtr       pDst,
-		    int             dx,
-		    int             dy,
-		    int             alu,
-		    Pixel           pm)
+void
+GLAMOExaDoneSolid(PixmapPtr pPix)
 {
-	ScrnInfoPtr pScrn = xf86Screens[pSrc->drawable.pScreen->myNum];
+	ScrnInfoPtr pScrn = xf86Screens[pPix->drawable.pScreen->myNum];
 	GlamoPtr pGlamo = GlamoPTR(pScrn);
 
+	GLAMOExaFinishSolid(pGlamo, pPix);
+	GLAMOStatEnd(pGlamo, GLAMO_STAT_SOLID, 0, 0);
+}
+
+static Bool
+GLAMOExaSetupCopy(GlamoPtr pGlamo, PixmapPtr pSrc, PixmapPtr pDst, int alu,
+		  Pixel pm)
+{
     RING_LOCALS;
 
     FbBits mask;
@@ -332,21 +1155,37 @@ GLAMOExaPrepareCopy(PixmapPtr       pSrc,
     CARD32 src_offset, dst_offset;
     CARD16 src_pitch, dst_pitch;
     CARD16 op;
+	int bpp = pDst->drawable.bitsPerPixel;
+	Pixel color;
 
-	if (pSrc->drawable.bitsPerPixel != 16 ||
-	    pDst->drawable.bitsPerPixel != 16)
-		GLAMO_FALLBACK(("Only 16bpp is supported"));
+	if (pSrc->drawable.bitsPerPixel != bpp || (bpp != 16 && bpp != 8))
+		GLAMO_FALLBACK(pGlamo, GLAMO_FALLBACK_BPP);
 
-	mask = FbFullMask(16);
+	mask = FbFullMask(bpp);
 	if ((pm & mask) != mask) {
-		GLAMO_FALLBACK(("Can't do planemask 0x%08x",
-				(unsigned int) pm));
+		GLAMO_FALLBACK(pGlamo, GLAMO_FALLBACK_PLANEMASK);
 	}
 
-	src_offset = exaGetPixmapOffset(pSrc);
+	/* Copying from a pixmap of one colour is filling with it. */
+	pGlamo->copy_as_solid = bpp == 16 &&
+				GLAMOPixmapIsSolid(pGlamo, pSrc, &color) &&
+				GLAMOExaSetupSolid(pGlamo, pDst, alu, pm, color);
+	if (pGlamo->copy_as_solid)
+		return TRUE;
+	pGlamo->copy_held = FALSE;
+
+	if (pSrc->devKind > GLAMO_HW_MAX_PITCH ||
+	    pDst->devKind > GLAMO_HW_MAX_PITCH)
+		GLAMO_FALLBACK(pGlamo, GLAMO_FALLBACK_PITCH);
+
+	pGlamo->draw_bytes = FALSE;
+	if (bpp == 8 && !GLAMOExaPrepareBytes(pGlamo, pSrc, pDst, alu, 0))
+		GLAMO_FALLBACK(pGlamo, GLAMO_FALLBACK_BYTE_ALIGN);
+
+	src_offset = GLAMOPixmapOffset(pSrc);
 	src_pitch = pSrc->devKind;
 
-	dst_offset = exaGetPixmapOffset(pDst);
+	dst_offset = GLAMOPixmapOffset(pDst);
 	dst_pitch = pDst->devKind;
 
 	op = GLAMOBltRop[alu] << 8;
@@ -365,25 +1204,77 @@ GLAMOExaPrepareCopy(PixmapPtr       pSrc,
 	OUT_REG(GLAMO_REG_2D_ID1, 0);
 	OUT_REG(GLAMO_REG_2D_ID2, 0);
 	END_CMDQ();
-
+	GLAMOExaResetClip(pGlamo);
+
+	GLAMOExaPrepareCPU(pGlamo, pSrc, pDst, alu, 20);
+	pGlamo->copy_src = pSrc;
+	pGlamo->copy_nbox = 0;
+	pGlamo->copy_same_pixmap = (src_offset == dst_offset);
+	pGlamo->copy_shift = 0;
+	pGlamo->copy_split = GLAMOPixmapIsLarge(pSrc) ||
+			     GLAMOPixmapIsLarge(pDst);
+	pGlamo->split_src.offset = src_offset;
+	pGlamo->split_src.pitch = src_pitch;
+	pGlamo->split_dst.offset = dst_offset;
+	pGlamo->split_dst.pitch = dst_pitch;
+
+	/* Distinct pixmaps whose memory overlaps */
+	if (src_offset != dst_offset &&
+	    src_offset < dst_offset + dst_pitch * pDst->drawable.height &&
+	    dst_offset < src_offset + src_pitch * pSrc->drawable.height) {
+		if (src_pitch != dst_pitch || pGlamo->draw_bytes)
+			GLAMO_FALLBACK(pGlamo, GLAMO_FALLBACK_OVERLAP_PITCH);
+		pGlamo->copy_shift = (long) dst_offset - (long) src_offset;
+		pGlamo->copy_pitch = dst_pitch;
+		pGlamo->copy_height = pDst->drawable.height;
+		GLAMOVRAMCompactStart(pGlamo);
+	}
 
 	return TRUE;
 }
 
-void
-GLAMOExaCopy(PixmapPtr       pDst,
-	      int    srcX,
-	      int    srcY,
-	      int    dstX,
-	      int    dstY,
-	      int    width,
-	      int    height)
+Bool
+GLAMOExaPrepareCopy(PixmapPtr       pSrc,
+		    PixmapPtr       pDst,
+		    int             dx,
+		    int             dy,
+		    int             alu,
+		    Pixel           pm)
 {
-	ScrnInfoPtr pScrn = xf86Screens[pDst->drawable.pScreen->myNum];
+	ScrnInfoPtr pScrn = xf86Screens[pSrc->drawable.pScreen->myNum];
 	GlamoPtr pGlamo = GlamoPTR(pScrn);
 
+	/* Only copies from VRAM to the shadowed screen go to the scanout. */
+	pGlamo->copy_to_shadow = GLAMOShadowIsScreen(pGlamo, pDst);
+	if (GLAMOShadowIsScreen(pGlamo, pSrc) ||
+	    (pGlamo->copy_to_shadow && !GLAMOShadowCanBlit(pGlamo, pDst)))
+		GLAMO_FALLBACK(pGlamo, GLAMO_FALLBACK_SHADOW);
+
+	if (!GLAMOExaSetupCopy(pGlamo, pSrc, pDst, alu, pm))
+		return FALSE;
+
+	GLAMOStatBegin(pGlamo, pGlamo->copy_as_solid ? GLAMO_STAT_SOLID :
+			       GLAMO_STAT_COPY);
+	return TRUE;
+}
+
+void
+GLAMOExaEmitCopy(GlamoPtr pGlamo,
+		 int srcX,
+		 int srcY,
+		 int dstX,
+		 int dstY,
+		 int width,
+		 int height)
+{
 	RING_LOCALS;
 
+	if (pGlamo->copy_split) {
+		GLAMOExaSplitBlt(pGlamo, TRUE, srcX, srcY, dstX, dstY,
+				 width, height);
+		return;
+	}
+
 	BEGIN_CMDQ(14);
 
 	OUT_REG(GLAMO_REG_2D_SRC_X, srcX);
@@ -397,22 +1288,837 @@ GLAMOExaCopy(PixmapPtr       pDst,
 }
 
 void
-GLAMOExaDoneCopy(PixmapPtr pDst)
+GLAMOExaSetSrc(GlamoPtr pGlamo, CARD32 offset, int pitch)
+{
+	RING_LOCALS;
+
+	BEGIN_CMDQ(6);
+	OUT_REG(GLAMO_REG_2D_SRC_ADDRL, offset & 0xffff);
+	OUT_REG(GLAMO_REG_2D_SRC_ADDRH, (offset >> 16) & 0x7f);
+	OUT_REG(GLAMO_REG_2D_SRC_PITCH, pitch & 0x7ff);
+	END_CMDQ();
+}
+
+void
+GLAMOExaSetupBlt(GlamoPtr pGlamo, CARD32 src_offset, int src_pitch,
+		 PixmapPtr pDst, CARD8 rop)
+{
+	CARD32 dst_offset = GLAMOPixmapOffset(pDst);
+	RING_LOCALS;
+
+	GLAMOExaSetSrc(pGlamo, src_offset, src_pitch);
+	pGlamo->copy_split = FALSE;
+	pGlamo->draw_bytes = FALSE;
+
+	BEGIN_CMDQ(14);
+	OUT_REG(GLAMO_REG_2D_DST_ADDRL, dst_offset & 0xffff);
+	OUT_REG(GLAMO_REG_2D_DST_ADDRH, (dst_offset >> 16) & 0x7f);
+	OUT_REG(GLAMO_REG_2D_DST_PITCH, pDst->devKind & 0x7ff);
+	OUT_REG(GLAMO_REG_2D_DST_HEIGHT, pDst->drawable.height);
+
+	OUT_REG(GLAMO_REG_2D_COMMAND2, rop << 8);
+	OUT_REG(GLAMO_REG_2D_ID1, 0);
+	OUT_REG(GLAMO_REG_2D_ID2, 0);
+	END_CMDQ();
+}
+
+/*
+ * Program the clip rectangle of the 2D engine, writing only the edges that
+ * changed.  glamo-regs.h documents neither an enable bit nor the edges;
+ * the clip is assumed to be always on, with inclusive right and bottom
+ * edges, which is why HWClip is off by default.  Returns the number of
+ * command words queued.
+ */
+int
+GLAMOExaSetClip(GlamoPtr pGlamo, int x1, int y1, int x2, int y2)
+{
+	BoxPtr clip = &pGlamo->hw_clip_box;
+	int n = (clip->x1 != x1) + (clip->y1 != y1) +
+		(clip->x2 != x2) + (clip->y2 != y2);
+	RING_LOCALS;
+
+	if (!n)
+		return 0;
+
+	BEGIN_CMDQ(2 * n);
+	if (clip->x1 != x1)
+		OUT_REG(GLAMO_REG_2D_LEFT_CLIP, x1);
+	if (clip->y1 != y1)
+		OUT_REG(GLAMO_REG_2D_TOP_CLIP, y1);
+	if (clip->x2 != x2)
+		OUT_REG(GLAMO_REG_2D_RIGHT_CLIP, x2 - 1);
+	if (clip->y2 != y2)
+		OUT_REG(GLAMO_REG_2D_BOTTOM_CLIP, y2 - 1);
+	END_CMDQ();
+
+	clip->x1 = x1;
+	clip->y1 = y1;
+	clip->x2 = x2;
+	clip->y2 = y2;
+
+	return 2 * n;
+}
+
+/* Open the clip rectangle up again for the paths which don't set it. */
+int
+GLAMOExaResetClip(GlamoPtr pGlamo)
+{
+	if (!pGlamo->hw_clip)
+		return 0;
+
+	return GLAMOExaSetClip(pGlamo, 0, 0,
+			       GLAMO_HW_CLIP_MAX, GLAMO_HW_CLIP_MAX);
+}
+
+/*
+ * The blitter has no programmable copy direction, so an overlapping copy
+ * within one pixmap is split into bands which are no larger than the
+ * distance between source and destination.  No band overlaps its own
+ * source, and the bands are ordered so that every band is copied before
+ * it gets overwritten by the next one.
+ */
+static void
+GLAMOExaOverlapCopy(GlamoPtr pGlamo,
+		    int srcX,
+		    int srcY,
+		    int dstX,
+		    int dstY,
+		    int width,
+		    int height)
+{
+	int dx = srcX - dstX;
+	int dy = srcY - dstY;
+	int band, pos, size;
+
+	if (abs(dy) >= abs(dx)) {
+		band = abs(dy);
+		if (dy > 0) {
+			for (pos = 0; pos < height; pos += band) {
+				size = min(band, height - pos);
+				GLAMOExaEmitCopy(pGlamo, srcX, srcY + pos,
+						 dstX, dstY + pos, width, size);
+			}
+		} else {
+			for (pos = height; pos > 0; pos -= band) {
+				size = min(band, pos);
+				GLAMOExaEmitCopy(pGlamo, srcX, srcY + pos - size,
+						 dstX, dstY + pos - size,
+						 width, size);
+			}
+		}
+	} else {
+		band = abs(dx);
+		if (dx > 0) {
+			for (pos = 0; pos < width; pos += band) {
+				size = min(band, width - pos);
+				GLAMOExaEmitCopy(pGlamo, srcX + pos, srcY,
+						 dstX + pos, dstY, size, height);
+			}
+		} else {
+			for (pos = width; pos > 0; pos -= band) {
+				size = min(band, pos);
+				GLAMOExaEmitCopy(pGlamo, srcX + pos - size, srcY,
+						 dstX + pos - size, dstY,
+						 size, height);
+			}
+		}
+	}
+}
+
+/* Narrowest piece of a row GLAMOExaShiftCopy blits, in pixels. */
+#define GLAMO_SHIFT_MIN_PIECE	32
+
+/* Blit between two VRAM offsets, outside of the current setup. */
+static void
+GLAMOExaBlitOffsets(GlamoPtr pGlamo, CARD32 dst, int dst_pitch, CARD32 src,
+		    int src_pitch, int width, int height)
+{
+	RING_LOCALS;
+
+	GLAMOExaSetSrc(pGlamo, src, src_pitch);
+	BEGIN_CMDQ(22);
+	OUT_REG(GLAMO_REG_2D_DST_ADDRL, dst & 0xffff);
+	OUT_REG(GLAMO_REG_2D_DST_ADDRH, (dst >> 16) & 0x7f);
+	OUT_REG(GLAMO_REG_2D_DST_PITCH, dst_pitch & 0x7ff);
+	OUT_REG(GLAMO_REG_2D_DST_HEIGHT, height);
+	OUT_REG(GLAMO_REG_2D_SRC_X, 0);
+	OUT_REG(GLAMO_REG_2D_SRC_Y, 0);
+	OUT_REG(GLAMO_REG_2D_DST_X, 0);
+	OUT_REG(GLAMO_REG_2D_DST_Y, 0);
+	OUT_REG(GLAMO_REG_2D_RECT_WIDTH, width);
+	OUT_REG(GLAMO_REG_2D_RECT_HEIGHT, height);
+	OUT_REG(GLAMO_REG_2D_COMMAND3, 0);
+	END_CMDQ();
+}
+
+/*
+ * Copy a rectangle of a shifted copy through the staging ring, in bands
+ * of rows that are read whole before any of them is written, so that a
+ * band may overlap its own source in any way.  Moving towards lower
+ * addresses the bands go top to bottom, else bottom to top, so no band
+ * overwrites the source of a later one.
+ */
+static void
+GLAMOExaBounceCopy(GlamoPtr pGlamo, int srcX, int srcY, int dstX, int dstY,
+		   int width, int height, Bool down)
+{
+	GlamoSurfacePtr src = &pGlamo->split_src;
+	GlamoSurfacePtr dst = &pGlamo->split_dst;
+	int pitch = width * 2;
+	int band = min(GLAMO_UPLOAD_RING_SIZE / pitch, GLAMO_HW_MAX_COORD);
+	int pos, size, row, x, w;
+	CARD32 stage;
+	RING_LOCALS;
+
+	for (pos = 0; pos < height; pos += size) {
+		size = min(band, height - pos);
+		row = down ? pos : height - pos - size;
+		stage = GLAMOExaUploadReserve(pGlamo, size * pitch);
+
+		for (x = 0; x < width; x += w) {
+			w = min(width - x, GLAMO_HW_MAX_COORD);
+			GLAMOExaBlitOffsets(pGlamo, stage + x * 2, pitch,
+					    src->offset + (srcY + row) *
+					    src->pitch + (srcX + x) * 2,
+					    src->pitch, w, size);
+		}
+		for (x = 0; x < width; x += w) {
+			w = min(width - x, GLAMO_HW_MAX_COORD);
+			GLAMOExaBlitOffsets(pGlamo, dst->offset + (dstY + row) *
+					    dst->pitch + (dstX + x) * 2,
+					    dst->pitch, stage + x * 2, pitch,
+					    w, size);
+		}
+	}
+
+	/* Back to the surfaces of the copy for the boxes that follow. */
+	GLAMOExaSetSrc(pGlamo, src->offset, src->pitch);
+	BEGIN_CMDQ(8);
+	OUT_REG(GLAMO_REG_2D_DST_ADDRL, dst->offset & 0xffff);
+	OUT_REG(GLAMO_REG_2D_DST_ADDRH, (dst->offset >> 16) & 0x7f);
+	OUT_REG(GLAMO_REG_2D_DST_PITCH, dst->pitch & 0x7ff);
+	OUT_REG(GLAMO_REG_2D_DST_HEIGHT, pGlamo->copy_height);
+	END_CMDQ();
+
+	pGlamo->copy_bounced++;
+}
+
+/*
+ * Copy between overlapping pixmaps of the same pitch, or rather between
+ * two overlapping byte ranges of VRAM.  As for copies within a pixmap the
+ * rectangle is split into pieces that don't overlap their own source:
+ * bands of whole rows if the distance is at least a row, pieces of rows
+ * otherwise.  Moving towards lower addresses the pieces go top to bottom
+ * and left to right, else the other way round.  Rather than cut rows into
+ * pieces narrower than GLAMO_SHIFT_MIN_PIECE, which takes a blit each,
+ * the rectangle is bounced through the staging ring.
+ */
+static void
+GLAMOExaShiftCopy(GlamoPtr pGlamo,
+		  int srcX,
+		  int srcY,
+		  int dstX,
+		  int dstY,
+		  int width,
+		  int height)
+{
+	int pitch = pGlamo->copy_pitch;
+	long delta = pGlamo->copy_shift + (long) (dstY - srcY) * pitch +
+		     (dstX - srcX) * 2;
+	long dist = labs(delta);
+	int band, pos, size, row, x, i;
+
+	if (!delta)
+		return;
+
+	if (dist >= (long) pitch * height) {
+		GLAMOExaEmitCopy(pGlamo, srcX, srcY, dstX, dstY, width, height);
+		return;
+	}
+
+	if (dist >= pitch) {
+		band = dist / pitch;
+		for (pos = 0; pos < height; pos += band) {
+			size = min(band, height - pos);
+			row = delta < 0 ? pos : height - pos - size;
+			GLAMOExaEmitCopy(pGlamo, srcX, srcY + row,
+					 dstX, dstY + row, width, size);
+		}
+		return;
+	}
+
+	band = dist / 2;
+	if (band < GLAMO_SHIFT_MIN_PIECE && band < width &&
+	    pGlamo->upload_area) {
+		GLAMOExaBounceCopy(pGlamo, srcX, srcY, dstX, dstY,
+				   width, height, delta < 0);
+		return;
+	}
+
+	for (i = 0; i < height; i++) {
+		row = delta < 0 ? i : height - 1 - i;
+		for (pos = 0; pos < width; pos += band) {
+			size = min(band, width - pos);
+			x = delta < 0 ? pos : width - pos - size;
+			GLAMOExaEmitCopy(pGlamo, srcX + x, srcY + row,
+					 dstX + x, dstY + row, size, 1);
+		}
+	}
+}
+
+/*
+ * Whether a blit to the rectangle would overwrite the source of a byte
+ * rectangle still queued for the CPU.
+ */
+static Bool
+GLAMOExaByteRectsRead(GlamoPtr pGlamo, int x1, int y1, int x2, int y2)
+{
+	GlamoByteRectPtr r;
+	int i;
+
+	for (i = 0, r = pGlamo->byte_rects; i < pGlamo->byte_nrect; i++, r++)
+		if (r->sx < x2 && r->sx + r->w > x1 &&
+		    r->sy < y2 && r->sy + r->h > y1)
+			return TRUE;
+
+	return FALSE;
+}
+
+/*
+ * An 8bpp copy.  When source and destination columns have the same parity
+ * the byte pairs in between are blitted as 16bpp pixels and the odd edge
+ * columns are copied by the CPU.  Otherwise, or when the rectangle
+ * overlaps its own source, all of it is.  The CPU part waits for the end
+ * of the batch and is then done in the order EXA gave the rectangles, so
+ * within one pixmap no rectangle reads what a later one writes.  Only a
+ * blit that would overwrite a queued source has to wait for it first.
+ */
+static void
+GLAMOExaCopyBytes(GlamoPtr pGlamo,
+		  int srcX,
+		  int srcY,
+		  int dstX,
+		  int dstY,
+		  int width,
+		  int height)
+{
+	int x1 = (dstX + 1) & ~1, x2 = (dstX + width) & ~1;
+
+	if (((srcX ^ dstX) & 1) ||
+	    (pGlamo->copy_same_pixmap &&
+	     abs(srcX - dstX) < width && abs(srcY - dstY) < height)) {
+		GLAMOExaQueueByteRect(pGlamo, srcX, srcY, dstX, dstY,
+				      width, height);
+	} else {
+		if (x1 < x2) {
+			if (pGlamo->copy_same_pixmap &&
+			    GLAMOExaByteRectsRead(pGlamo, x1, dstY, x2,
+						  dstY + height))
+				GLAMOExaFlushByteRects(pGlamo);
+			GLAMOExaEmitCopy(pGlamo, (srcX + x1 - dstX) / 2, srcY,
+					 x1 / 2, dstY, (x2 - x1) / 2, height);
+		}
+		if (dstX & 1)
+			GLAMOExaQueueByteRect(pGlamo, srcX, srcY, dstX, dstY,
+					      1, height);
+		if ((dstX + width) & 1)
+			GLAMOExaQueueByteRect(pGlamo, srcX + width - 1, srcY,
+					      dstX + width - 1, dstY,
+					      1, height);
+	}
+}
+
+/* Rows in which GLAMOExaMoveVRAM copies a block, in bytes. */
+#define GLAMO_MOVE_PITCH	1024
+
+/*
+ * The block is copied as bands of rows of GLAMO_MOVE_PITCH bytes, each
+ * band addressed from its own start so the coordinates stay small, and
+ * what is left over as one shorter row.  Outside of any operation.
+ */
+void
+GLAMOExaMoveVRAM(GlamoPtr pGlamo, CARD32 dst, CARD32 src, int size)
+{
+	int rows, width;
+	RING_LOCALS;
+
+	GLAMOExaResetClip(pGlamo);
+	pGlamo->copy_split = FALSE;
+
+	while (size > 1) {
+		rows = min(size / GLAMO_MOVE_PITCH, GLAMO_HW_MAX_COORD);
+		width = GLAMO_MOVE_PITCH / 2;
+		if (!rows) {
+			rows = 1;
+			width = size / 2;
+		}
+
+		GLAMOExaSetSrc(pGlamo, src, GLAMO_MOVE_PITCH);
+		BEGIN_CMDQ(14);
+		OUT_REG(GLAMO_REG_2D_DST_ADDRL, dst & 0xffff);
+		OUT_REG(GLAMO_REG_2D_DST_ADDRH, (dst >> 16) & 0x7f);
+		OUT_REG(GLAMO_REG_2D_DST_PITCH, GLAMO_MOVE_PITCH);
+		OUT_REG(GLAMO_REG_2D_DST_HEIGHT, rows);
+		OUT_REG(GLAMO_REG_2D_COMMAND2, GLAMOBltRop[GXcopy] << 8);
+		OUT_REG(GLAMO_REG_2D_ID1, 0);
+		OUT_REG(GLAMO_REG_2D_ID2, 0);
+		END_CMDQ();
+		GLAMOExaEmitCopy(pGlamo, 0, 0, 0, 0, width, rows);
+
+		src += rows * width * 2;
+		dst += rows * width * 2;
+		size -= rows * width * 2;
+	}
+}
+
+/*
+ * Emit the queued copies, as one blit over their extents clipped to each
+ * of them when that is shorter than a blit for each.
+ */
+static void
+GLAMOExaFlushClipCopy(GlamoPtr pGlamo)
+{
+	BoxPtr box = pGlamo->copy_boxes;
+	BoxRec extents;
+	int i, n = pGlamo->copy_nbox, dx = pGlamo->copy_dx, dy = pGlamo->copy_dy;
+	int clip;
+	RING_LOCALS;
+
+	if (!n)
+		return;
+	pGlamo->copy_nbox = 0;
+
+	clip = 12 + GLAMOExaClipCost(pGlamo, box, n, &extents);
+	if (clip >= 14 * n) {
+		for (i = 0; i < n; i++, box++)
+			GLAMOExaEmitCopy(pGlamo, box->x1 + dx, box->y1 + dy,
+					 box->x1, box->y1, box->x2 - box->x1,
+					 box->y2 - box->y1);
+		return;
+	}
+
+	BEGIN_CMDQ(12);
+	OUT_REG(GLAMO_REG_2D_SRC_X, extents.x1 + dx);
+	OUT_REG(GLAMO_REG_2D_SRC_Y, extents.y1 + dy);
+	OUT_REG(GLAMO_REG_2D_DST_X, extents.x1);
+	OUT_REG(GLAMO_REG_2D_DST_Y, extents.y1);
+	OUT_REG(GLAMO_REG_2D_RECT_WIDTH, extents.x2 - extents.x1);
+	OUT_REG(GLAMO_REG_2D_RECT_HEIGHT, extents.y2 - extents.y1);
+	END_CMDQ();
+	GLAMOExaEmitClipped(pGlamo, pGlamo->copy_boxes, n);
+
+	pGlamo->hw_clip_words_saved += 14 * n - clip;
+	pGlamo->hw_clip_requests++;
+}
+
+/*
+ * The clip only bounds what is written, so the extents of copies within
+ * one pixmap may read what an earlier box of the batch wrote; each box
+ * still reads only its own source, in the order EXA gave them.
+ */
+static void
+GLAMOExaQueueClipCopy(GlamoPtr pGlamo, int srcX, int srcY, int dstX,
+		      int dstY, int width, int height)
+{
+	BoxPtr box;
+
+	if (pGlamo->copy_nbox == GLAMO_SOLID_BATCH_SIZE ||
+	    (pGlamo->copy_nbox && (srcX - dstX != pGlamo->copy_dx ||
+				   srcY - dstY != pGlamo->copy_dy)))
+		GLAMOExaFlushClipCopy(pGlamo);
+
+	pGlamo->copy_dx = srcX - dstX;
+	pGlamo->copy_dy = srcY - dstY;
+	box = &pGlamo->copy_boxes[pGlamo->copy_nbox++];
+	box->x1 = dstX;
+	box->y1 = dstY;
+	box->x2 = dstX + width;
+	box->y2 = dstY + height;
+}
+
+static void
+GLAMOExaCopyBox(GlamoPtr pGlamo, int srcX, int srcY, int dstX, int dstY,
+		int width, int height)
+{
+	if (pGlamo->draw_bytes) {
+		pGlamo->draw_blitted = TRUE;
+		GLAMOExaCopyBytes(pGlamo, srcX, srcY, dstX, dstY,
+				  width, height);
+		return;
+	}
+
+	/* Within one pixmap, only before any blit it could depend on. */
+	if (!pGlamo->copy_shift &&
+	    (!pGlamo->copy_same_pixmap || !pGlamo->draw_blitted) &&
+	    GLAMOExaUseCPU(pGlamo, GLAMO_COST_COPY, width, height)) {
+		GLAMOExaCPUMove(pGlamo->cpu_dst + dstY * pGlamo->cpu_dst_pitch +
+				dstX * 2, pGlamo->cpu_dst_pitch,
+				pGlamo->cpu_src + srcY * pGlamo->cpu_src_pitch +
+				srcX * 2, pGlamo->cpu_src_pitch,
+				width, height);
+		return;
+	}
+	pGlamo->draw_blitted = TRUE;
+
+	if (pGlamo->copy_same_pixmap) {
+		if (srcX == dstX && srcY == dstY)
+			return;
+		if (abs(srcX - dstX) < width && abs(srcY - dstY) < height) {
+			GLAMOExaFlushClipCopy(pGlamo);
+			GLAMOExaOverlapCopy(pGlamo, srcX, srcY, dstX, dstY,
+					    width, height);
+			return;
+		}
+	}
+
+	if (pGlamo->copy_shift) {
+		GLAMOExaShiftCopy(pGlamo, srcX, srcY, dstX, dstY,
+				  width, height);
+		return;
+	}
+
+	if (pGlamo->hw_clip && !pGlamo->copy_split) {
+		GLAMOExaQueueClipCopy(pGlamo, srcX, srcY, dstX, dstY,
+				      width, height);
+		return;
+	}
+
+	GLAMOExaEmitCopy(pGlamo, srcX, srcY, dstX, dstY, width, height);
+}
+
+static void
+GLAMOExaFlushCopy(GlamoPtr pGlamo)
+{
+	BoxPtr box = &pGlamo->copy_held_box;
+
+	if (!pGlamo->copy_held)
+		return;
+
+	GLAMOExaCopyBox(pGlamo, box->x1 + pGlamo->copy_held_dx,
+			box->y1 + pGlamo->copy_held_dy, box->x1, box->y1,
+			box->x2 - box->x1, box->y2 - box->y1);
+	pGlamo->copy_held = FALSE;
+}
+
+/* Grow the box by one sharing a whole edge with it, if that is one. */
+static Bool
+GLAMOBoxAppend(BoxPtr box, int x1, int y1, int x2, int y2)
+{
+	if (y1 == box->y1 && y2 == box->y2) {
+		if (x1 == box->x2) {
+			box->x2 = x2;
+			return TRUE;
+		}
+		if (x2 == box->x1) {
+			box->x1 = x1;
+			return TRUE;
+		}
+	} else if (x1 == box->x1 && x2 == box->x2) {
+		if (y1 == box->y2) {
+			box->y2 = y2;
+			return TRUE;
+		}
+		if (y2 == box->y1) {
+			box->y1 = y1;
+			return TRUE;
+		}
+	}
+
+	return FALSE;
+}
+
+/*
+ * Boxes are held back and merged while they continue the previous one
+ * with the same source offset, which is how regions split into bands by
+ * overlapping windows come.  EXA orders the boxes of a copy within one
+ * pixmap so that doing them one after the other is the same as doing the
+ * whole region at once, so doing two of them as one box doesn't change
+ * the result either.
+ */
+static void
+GLAMOExaQueueCopy(GlamoPtr pGlamo, PixmapPtr pDst, int srcX, int srcY,
+		  int dstX, int dstY, int width, int height)
+{
+	BoxPtr box = &pGlamo->copy_held_box;
+
+	if (pGlamo->copy_as_solid) {
+		pGlamo->solid_copies_filled++;
+		GLAMOExaQueueSolid(pGlamo, pDst, dstX, dstY, dstX + width,
+				   dstY + height);
+		return;
+	}
+
+	GLAMOPixmapDirty(pGlamo, pDst, dstX, dstY, dstX + width, dstY + height);
+
+	if (pGlamo->copy_held && !pGlamo->copy_shift &&
+	    srcX - dstX == pGlamo->copy_held_dx &&
+	    srcY - dstY == pGlamo->copy_held_dy &&
+	    GLAMOBoxAppend(box, dstX, dstY, dstX + width, dstY + height)) {
+		pGlamo->copy_merged++;
+		return;
+	}
+
+	GLAMOExaFlushCopy(pGlamo);
+	pGlamo->copy_held = TRUE;
+	pGlamo->copy_held_dx = srcX - dstX;
+	pGlamo->copy_held_dy = srcY - dstY;
+	box->x1 = dstX;
+	box->y1 = dstY;
+	box->x2 = dstX + width;
+	box->y2 = dstY + height;
+}
+
+void
+GLAMOExaCopy(PixmapPtr       pDst,
+	      int    srcX,
+	      int    srcY,
+	      int    dstX,
+	      int    dstY,
+	      int    width,
+	      int    height)
 {
 	ScrnInfoPtr pScrn = xf86Screens[pDst->drawable.pScreen->myNum];
 	GlamoPtr pGlamo = GlamoPTR(pScrn);
 
+	pGlamo->stats[pGlamo->copy_as_solid ? GLAMO_STAT_SOLID :
+		      GLAMO_STAT_COPY].pixels += width * height;
+	if (pGlamo->copy_to_shadow)
+		GLAMOShadowBlitted(pGlamo, dstX, dstY, dstX + width,
+				   dstY + height);
+	GLAMOExaQueueCopy(pGlamo, pDst, srcX, srcY, dstX, dstY, width, height);
+}
+
+static void
+GLAMOExaFinishCopy(GlamoPtr pGlamo, PixmapPtr pDst)
+{
+	if (pGlamo->copy_as_solid) {
+		GLAMOExaFinishSolid(pGlamo, pDst);
+		return;
+	}
+
+	GLAMOExaFlushCopy(pGlamo);
+	GLAMOExaFlushClipCopy(pGlamo);
+	GLAMOExaFlushByteRects(pGlamo);
+	if (!GLAMOExaDropSetup(pGlamo)) {
+		GLAMOPixmapFence(pGlamo, pGlamo->copy_src);
+		GLAMOPixmapFence(pGlamo, pDst);
+	}
+
     GLAMOFlushCMDQCache(pGlamo, 1);
 	exaMarkSync(pGlamo->pScreen);
 }
 
+void
+GLAMOExaDoneCopy(PixmapPtr pDst)
+{
+	ScrnInfoPtr pScrn = xf86Screens[pDst->drawable.pScreen->myNum];
+	GlamoPtr pGlamo = GlamoPTR(pScrn);
+
+	GLAMOExaFinishCopy(pGlamo, pDst);
+	GLAMOStatEnd(pGlamo, pGlamo->copy_as_solid ? GLAMO_STAT_SOLID :
+			     GLAMO_STAT_COPY, 0, 0);
+}
+
+#define GLAMO_COMPOSITE_FALLBACK(pGlamo, reason)		\
+do {								\
+	(pGlamo)->composite_fallback[reason]++;			\
+	return FALSE;						\
+} while (0)
+
+static Bool
+GLAMOIsSolidPicture(PicturePtr pPicture)
+{
+	return pPicture->repeat &&
+	       pPicture->pDrawable->width == 1 &&
+	       pPicture->pDrawable->height == 1;
+}
+
+/*
+ * The 2D engine can neither blend nor convert between formats.  The
+ * composites it can do are those which turn into a plain copy or fill on
+ * an r5g6b5 destination:
+ *  - PictOpClear,
+ *  - PictOpSrc from an r5g6b5 picture or a 1x1 repeating solid,
+ *  - PictOpSrc from a repeating picture, tiled by doubling copies,
+ *  - PictOpOver from any of those as long as the source is opaque.
+ * The common blending and converting ones are done by the CPU, see
+ * glamo-blend.c.
+ */
 Bool
 GLAMOExaCheckComposite(int op,
 		       PicturePtr   pSrcPicture,
 		       PicturePtr   pMaskPicture,
 		       PicturePtr   pDstPicture)
 {
-	return FALSE;
+	ScrnInfoPtr pScrn = xf86Screens[pDstPicture->pDrawable->pScreen->myNum];
+	GlamoPtr pGlamo = GlamoPTR(pScrn);
+
+	if (GLAMOBlendCheck(op, pSrcPicture, pMaskPicture, pDstPicture) ||
+	    GLAMOConvertCheck(op, pSrcPicture, pMaskPicture, pDstPicture))
+		return TRUE;
+
+	if (op != PictOpClear && op != PictOpSrc && op != PictOpOver)
+		GLAMO_COMPOSITE_FALLBACK(pGlamo, GLAMO_COMPOSITE_FALLBACK_OP);
+
+	if (pMaskPicture)
+		GLAMO_COMPOSITE_FALLBACK(pGlamo, GLAMO_COMPOSITE_FALLBACK_MASK);
+
+	if (pDstPicture->format != PICT_r5g6b5)
+		GLAMO_COMPOSITE_FALLBACK(pGlamo,
+					 GLAMO_COMPOSITE_FALLBACK_DST_FORMAT);
+
+	if (pDstPicture->alphaMap)
+		GLAMO_COMPOSITE_FALLBACK(pGlamo,
+					 GLAMO_COMPOSITE_FALLBACK_ALPHA_MAP);
+
+	if (op == PictOpClear)
+		return TRUE;
+
+	if (!pSrcPicture->pDrawable)
+		GLAMO_COMPOSITE_FALLBACK(pGlamo,
+					 GLAMO_COMPOSITE_FALLBACK_SOURCE_PICT);
+
+	if (pSrcPicture->alphaMap)
+		GLAMO_COMPOSITE_FALLBACK(pGlamo,
+					 GLAMO_COMPOSITE_FALLBACK_ALPHA_MAP);
+
+	/* The colour of a solid source is looked at in PrepareComposite. */
+	if (GLAMOIsSolidPicture(pSrcPicture)) {
+		switch (pSrcPicture->format) {
+		case PICT_a8r8g8b8:
+		case PICT_x8r8g8b8:
+		case PICT_r5g6b5:
+			return TRUE;
+		default:
+			GLAMO_COMPOSITE_FALLBACK(pGlamo,
+					GLAMO_COMPOSITE_FALLBACK_SRC_FORMAT);
+		}
+	}
+
+	/*
+	 * Repeating sources are tiled.  Opaque 32 bit ones are converted
+	 * to r5g6b5 first.
+	 */
+	if (pSrcPicture->repeat) {
+		if (pSrcPicture->repeatType != RepeatNormal ||
+		    pSrcPicture->transform)
+			GLAMO_COMPOSITE_FALLBACK(pGlamo,
+					GLAMO_COMPOSITE_FALLBACK_REPEAT);
+		switch (pSrcPicture->format) {
+		case PICT_a8r8g8b8:
+			if (op == PictOpSrc)
+				return TRUE;
+			GLAMO_COMPOSITE_FALLBACK(pGlamo,
+					GLAMO_COMPOSITE_FALLBACK_TRANSLUCENT);
+		case PICT_x8r8g8b8:
+		case PICT_r5g6b5:
+			return TRUE;
+		default:
+			GLAMO_COMPOSITE_FALLBACK(pGlamo,
+					GLAMO_COMPOSITE_FALLBACK_SRC_FORMAT);
+		}
+	}
+
+	/*
+	 * The blitter's rotation registers are undocumented, and rotating
+	 * with the CPU in uncached VRAM is slower than the fallback.
+	 */
+	if (pSrcPicture->transform)
+		GLAMO_COMPOSITE_FALLBACK(pGlamo,
+					 GLAMO_COMPOSITE_FALLBACK_TRANSFORM);
+
+	/* r5g6b5 has no alpha, so Over is the same as Src. */
+	if (pSrcPicture->format != PICT_r5g6b5)
+		GLAMO_COMPOSITE_FALLBACK(pGlamo,
+					 GLAMO_COMPOSITE_FALLBACK_SRC_FORMAT);
+
+	return TRUE;
+}
+
+/*
+ * Read the pixel of a 1x1 source and convert it to r5g6b5.  Returns the
+ * alpha of the source in *alpha.
+ */
+static CARD16
+GLAMOReadSolidPixel(GlamoPtr pGlamo, PixmapPtr pPix, PictFormatShort format,
+		    CARD8 *alpha)
+{
+	CARD8 *ptr;
+	CARD32 pixel;
+
+	/* The pixel may still be written by a queued blit. */
+	GLAMOPixmapWait(pGlamo, pPix);
+
+	ptr = pGlamo->exa->memoryBase + GLAMOPixmapOffset(pPix);
+
+	if (format == PICT_r5g6b5) {
+		*alpha = 0xff;
+		return *(CARD16 *)ptr;
+	}
+
+	pixel = *(CARD32 *)ptr;
+	*alpha = (format == PICT_a8r8g8b8) ? pixel >> 24 : 0xff;
+
+	return ((pixel >> 8) & 0xf800) |
+	       ((pixel >> 5) & 0x07e0) |
+	       ((pixel >> 3) & 0x001f);
+}
+
+/*
+ * The tile of a repeating source is the source pixmap itself if it is
+ * r5g6b5.  Otherwise one period is converted into the upload ring.
+ */
+static Bool
+GLAMOCompositeTilePrepare(GlamoPtr pGlamo, PicturePtr pSrcPicture,
+			  PixmapPtr pSrc, PixmapPtr pDst)
+{
+	GlamoSurfacePtr tile = &pGlamo->composite_tile;
+	int w = pSrc->drawable.width, h = pSrc->drawable.height;
+	CARD8 *src;
+
+	/* Tiling doesn't split its blits. */
+	if (pSrc == pDst || GLAMOPixmapIsLarge(pSrc) ||
+	    GLAMOPixmapIsLarge(pDst))
+		return FALSE;
+
+	if (pSrcPicture->format == PICT_r5g6b5) {
+		tile->offset = GLAMOPixmapOffset(pSrc);
+		tile->pitch = pSrc->devKind;
+		return TRUE;
+	}
+
+	tile->pitch = (w * 2 + 3) & ~3;
+	if (!pGlamo->upload_area || tile->pitch * h > GLAMO_UPLOAD_RING_SIZE)
+		return FALSE;
+
+	src = GLAMOConvertPixels(pGlamo, pSrc);
+	if (!src || (unsigned long)src & 3)
+		return FALSE;
+
+	tile->offset = GLAMOExaUploadReserve(pGlamo, tile->pitch * h);
+	GLAMOConvertRect(pGlamo, pGlamo->exa->memoryBase + tile->offset,
+			 tile->pitch, src, pSrc->devKind, 0, 0, w, h);
+
+	return TRUE;
+}
+
+static void
+GLAMOCompositeTile(GlamoPtr pGlamo, PixmapPtr pDst, int srcX, int srcY,
+		   int dstX, int dstY, int width, int height)
+{
+	PixmapPtr pSrc = pGlamo->composite_src;
+	BoxRec box;
+
+	box.x1 = dstX;
+	box.y1 = dstY;
+	box.x2 = dstX + width;
+	box.y2 = dstY + height;
+
+	GLAMOPixmapDirty(pGlamo, pDst, box.x1, box.y1, box.x2, box.y2);
+	GLAMOTileBoxes(pGlamo, pGlamo->composite_tile.offset,
+		       pGlamo->composite_tile.pitch, 0, 0,
+		       pSrc->drawable.width, pSrc->drawable.height, pDst,
+		       &box, 1, dstX - srcX, dstY - srcY, 0, 0);
 }
 
 Bool
@@ -424,7 +2130,76 @@ GLAMOExaPrepareComposite(int                op,
 			 PixmapPtr          pMask,
 			 PixmapPtr          pDst)
 {
-	return FALSE;
+	ScrnInfoPtr pScrn = xf86Screens[pDst->drawable.pScreen->myNum];
+	GlamoPtr pGlamo = GlamoPTR(pScrn);
+	CARD16 color = 0;
+	CARD8 alpha;
+	enum GLAMOCompositeMode mode;
+	Bool ret;
+
+	if (GLAMOShadowIsScreen(pGlamo, pDst) ||
+	    (pSrc && GLAMOShadowIsScreen(pGlamo, pSrc)) ||
+	    (pMask && GLAMOShadowIsScreen(pGlamo, pMask)))
+		GLAMO_COMPOSITE_FALLBACK(pGlamo,
+					 GLAMO_COMPOSITE_FALLBACK_SHADOW);
+
+	if (op == PictOpClear) {
+		mode = GLAMO_COMPOSITE_FILL;
+	} else if (GLAMOIsSolidPicture(pSrcPicture)) {
+		color = GLAMOReadSolidPixel(pGlamo, pSrc, pSrcPicture->format,
+					    &alpha);
+		if (op == PictOpOver && alpha == 0)
+			mode = GLAMO_COMPOSITE_NOOP;
+		else if (op == PictOpOver && (alpha != 0xff || pMask))
+			mode = GLAMO_COMPOSITE_BLEND;
+		else
+			mode = GLAMO_COMPOSITE_FILL;
+	} else if (pSrcPicture->repeat) {
+		mode = GLAMO_COMPOSITE_TILE;
+	} else if (op == PictOpOver &&
+		   pSrcPicture->format == PICT_a8r8g8b8) {
+		mode = GLAMO_COMPOSITE_BLEND;
+	} else if (pSrcPicture->format != PICT_r5g6b5) {
+		mode = GLAMO_COMPOSITE_CONVERT;
+	} else {
+		mode = GLAMO_COMPOSITE_COPY;
+	}
+
+	switch (mode) {
+	case GLAMO_COMPOSITE_FILL:
+		ret = GLAMOExaSetupSolid(pGlamo, pDst, GXcopy, FB_ALLONES,
+					 color);
+		break;
+	case GLAMO_COMPOSITE_COPY:
+		ret = GLAMOExaSetupCopy(pGlamo, pSrc, pDst, GXcopy, FB_ALLONES);
+		break;
+	case GLAMO_COMPOSITE_BLEND:
+		ret = GLAMOBlendPrepare(pGlamo, pSrcPicture, pSrc, pMask, pDst);
+		break;
+	case GLAMO_COMPOSITE_CONVERT:
+		ret = GLAMOConvertPrepare(pGlamo, pSrc, pDst);
+		break;
+	case GLAMO_COMPOSITE_TILE:
+		ret = GLAMOCompositeTilePrepare(pGlamo, pSrcPicture, pSrc,
+						pDst);
+		break;
+	default:
+		ret = TRUE;
+		break;
+	}
+
+	if (!ret)
+		GLAMO_COMPOSITE_FALLBACK(pGlamo,
+					 GLAMO_COMPOSITE_FALLBACK_PREPARE);
+
+	pGlamo->composite_src = pSrc;
+	pGlamo->composite_over = (op == PictOpOver);
+
+	pGlamo->composite_mode = mode;
+	pGlamo->composite_accel[mode]++;
+	GLAMOStatBegin(pGlamo, GLAMO_STAT_COMPOSITE);
+
+	return TRUE;
 }
 
 void
@@ -438,11 +2213,139 @@ GLAMOExaComposite(PixmapPtr pDst,
 		 int width,
 		 int height)
 {
+	ScrnInfoPtr pScrn = xf86Screens[pDst->drawable.pScreen->myNum];
+	GlamoPtr pGlamo = GlamoPTR(pScrn);
+
+	pGlamo->stats[GLAMO_STAT_COMPOSITE].pixels += width * height;
+
+	switch (pGlamo->composite_mode) {
+	case GLAMO_COMPOSITE_FILL:
+		GLAMOExaQueueSolid(pGlamo, pDst, dstX, dstY, dstX + width,
+				   dstY + height);
+		break;
+	case GLAMO_COMPOSITE_COPY:
+		GLAMOExaQueueCopy(pGlamo, pDst, srcX, srcY, dstX, dstY,
+				  width, height);
+		break;
+	case GLAMO_COMPOSITE_BLEND:
+		GLAMOBlendComposite(pGlamo, pDst, srcX, srcY, maskX, maskY,
+				    dstX, dstY, width, height);
+		break;
+	case GLAMO_COMPOSITE_CONVERT:
+		GLAMOConvertComposite(pGlamo, pDst, srcX, srcY, dstX, dstY,
+				      width, height);
+		break;
+	case GLAMO_COMPOSITE_TILE:
+		GLAMOCompositeTile(pGlamo, pDst, srcX, srcY, dstX, dstY,
+				   width, height);
+		break;
+	default:
+		break;
+	}
 }
 
 void
 GLAMOExaDoneComposite(PixmapPtr pDst)
 {
+	ScrnInfoPtr pScrn = xf86Screens[pDst->drawable.pScreen->myNum];
+	GlamoPtr pGlamo = GlamoPTR(pScrn);
+
+	switch (pGlamo->composite_mode) {
+	case GLAMO_COMPOSITE_FILL:
+		GLAMOExaFinishSolid(pGlamo, pDst);
+		break;
+	case GLAMO_COMPOSITE_COPY:
+		GLAMOExaFinishCopy(pGlamo, pDst);
+		break;
+	case GLAMO_COMPOSITE_TILE:
+		GLAMOPixmapFence(pGlamo, pGlamo->composite_src);
+		GLAMOPixmapFence(pGlamo, pDst);
+		GLAMOFlushCMDQCache(pGlamo, 1);
+		exaMarkSync(pGlamo->pScreen);
+		break;
+	default:
+		break;
+	}
+
+	GLAMOStatEnd(pGlamo, GLAMO_STAT_COMPOSITE, 0, 0);
+}
+
+void
+GLAMOExaUploadRingInit(GlamoPtr pGlamo)
+{
+	if (!pGlamo->upload_area) {
+		pGlamo->upload_area = GLAMOVRAMAlloc(pGlamo, GLAMO_VRAM_UPLOAD,
+						     GLAMO_UPLOAD_RING_SIZE);
+	}
+	pGlamo->upload_head = 0;
+}
+
+/*
+ * Take size bytes from the staging ring and return their offset in VRAM.
+ * Wrapping around waits for the blits reading the old data.
+ */
+static CARD32
+GLAMOExaUploadReserve(GlamoPtr pGlamo, int size)
+{
+	CARD32 offset;
+
+	if (pGlamo->upload_head + size > GLAMO_UPLOAD_RING_SIZE) {
+		GLAMOFlushCMDQCache(pGlamo, 1);
+		GLAMOEngineWait(pGlamo, GLAMO_ENGINE_ALL);
+		pGlamo->upload_head = 0;
+		pGlamo->upload_wraps++;
+	}
+
+	offset = pGlamo->upload_area->offset + pGlamo->upload_head;
+	pGlamo->upload_head += size;
+
+	return offset;
+}
+
+/*
+ * Copy rows of pixels into the staging ring, packed so that they are
+ * written strictly sequentially, and queue a blit of them to the
+ * destination.  The CPU never waits for the destination to become idle,
+ * only for blits out of the ring when it wraps around.
+ */
+static void
+GLAMOExaUploadStaged(GlamoPtr pGlamo, PixmapPtr pDst, int x, int y,
+		     int w, int h, char *src, int src_pitch)
+{
+	CARD32 pitch = (w * 2 + 3) & ~3;
+	CARD32 offset;
+	int rows;
+	CARD8 *dst;
+
+	GLAMOExaSetupBlt(pGlamo, 0, pitch, pDst, GLAMOBltRop[GXcopy]);
+	if (GLAMOPixmapIsLarge(pDst)) {
+		pGlamo->copy_split = TRUE;
+		pGlamo->split_src.pitch = pitch;
+		pGlamo->split_dst.offset = GLAMOPixmapOffset(pDst);
+		pGlamo->split_dst.pitch = pDst->devKind;
+	}
+
+	while (h) {
+		rows = min(h, GLAMO_UPLOAD_RING_SIZE / pitch);
+		offset = GLAMOExaUploadReserve(pGlamo, rows * pitch);
+
+		dst = pGlamo->exa->memoryBase + offset;
+		GLAMOTransferRect(pGlamo->upload_row, dst, pitch,
+				  (CARD8 *)src, src_pitch, w * 2, rows);
+		src += rows * src_pitch;
+
+		pGlamo->split_src.offset = offset;
+		if (!pGlamo->copy_split)
+			GLAMOExaSetSrc(pGlamo, offset, pitch);
+		GLAMOExaEmitCopy(pGlamo, 0, 0, x, y, w, rows);
+
+		y += rows;
+		h -= rows;
+	}
+
+	GLAMOPixmapFence(pGlamo, pDst);
+	GLAMOFlushCMDQCache(pGlamo, 1);
+	exaMarkSync(pGlamo->pScreen);
 }
 
 Bool
@@ -457,20 +2360,43 @@ GLAMOExaUploadToScreen(PixmapPtr pDst,
 	ScrnInfoPtr pScrn = xf86Screens[pDst->drawable.pScreen->myNum];
 	GlamoPtr pGlamo = GlamoPTR(pScrn);
 
-	int bpp, i;
+	int bpp;
 	CARD8 *dst_offset;
 	int dst_pitch;
 
+	if (w <= 0 || h <= 0)
+		return TRUE;
+
+	/* fb draws to the shadow once it has caught up with the scanout. */
+	if (GLAMOShadowIsScreen(pGlamo, pDst))
+		return FALSE;
+
 	bpp = pDst->drawable.bitsPerPixel / 8;
+
+	GLAMOStatBegin(pGlamo, GLAMO_STAT_UPLOAD);
+	GLAMOPixmapDirty(pGlamo, pDst, x, y, x + w, y + h);
+
+	/* Both the staging and the destination pitch must fit the engine. */
+	if (pGlamo->upload_area && bpp == 2 && w < GLAMO_HW_MAX_PITCH / 2 &&
+	    pDst->devKind <= GLAMO_HW_MAX_PITCH) {
+		GLAMOExaUploadStaged(pGlamo, pDst, x, y, w, h, src, src_pitch);
+		pGlamo->upload_staged++;
+		GLAMOStatEnd(pGlamo, GLAMO_STAT_UPLOAD, w * h, w * h * bpp);
+		return TRUE;
+	}
+
+	/* The blitter may still be using the destination. */
+	GLAMOPixmapWait(pGlamo, pDst);
+	pGlamo->upload_direct++;
+
 	dst_pitch = pDst->devKind;
-	dst_offset = pGlamo->exa->memoryBase + exaGetPixmapOffset(pDst)
+	dst_offset = pGlamo->exa->memoryBase + GLAMOPixmapOffset(pDst)
 						+ x*bpp + y*dst_pitch;
 
-	for (i = 0; i < h; i++) {
-		memcpy(dst_offset, src, w*bpp);
-		dst_offset += dst_pitch;
-		src += src_pitch;
-	}
+	GLAMOTransferRect(pGlamo->upload_row, dst_offset, dst_pitch,
+			  (CARD8 *)src, src_pitch, w*bpp, h);
+
+	GLAMOStatEnd(pGlamo, GLAMO_STAT_UPLOAD, w * h, w * h * bpp);
 
 	return TRUE;
 }
@@ -485,23 +2411,47 @@ GLAMOExaDownloadFromScreen(PixmapPtr pSrc,
 	ScrnInfoPtr pScrn = xf86Screens[pSrc->drawable.pScreen->myNum];
 	GlamoPtr pGlamo = GlamoPTR(pScrn);
 
-	int bpp, i;
-	CARD8 *dst_offset, *src;
-	int src_pitch;
+	int bpp;
+	CARD8 *src, *cache;
+	int src_pitch, i;
+	Pixel color;
+
+	if (GLAMOShadowIsScreen(pGlamo, pSrc))
+		return FALSE;
+
+	GLAMOStatBegin(pGlamo, GLAMO_STAT_DOWNLOAD);
 
 	bpp = pSrc->drawable.bitsPerPixel;
+	if (GLAMOPixmapIsSolid(pGlamo, pSrc, &color)) {
+		GLAMOFillMemory((CARD8 *)dst, dst_pitch, bpp, w, h, color);
+		pGlamo->solid_readbacks++;
+		GLAMOStatEnd(pGlamo, GLAMO_STAT_DOWNLOAD, w * h, 0);
+		return TRUE;
+	}
+
 	bpp /= 8;
 	src_pitch = pSrc->devKind;
-	src = pGlamo->exa->memoryBase + exaGetPixmapOffset(pSrc) +
-						x*bpp + y*src_pitch;
-	dst_offset = (unsigned char*)dst;
 
-	for (i = 0; i < h; i++) {
-		memcpy(dst_offset, src, w*bpp);
-		dst_offset += dst_pitch;
-		src += src_pitch;
+	cache = GLAMOPixmapCache(pGlamo, pSrc);
+	if (cache) {
+		src = cache + x*bpp + y*src_pitch;
+		for (i = 0; i < h; i++)
+			memcpy(dst + i * dst_pitch, src + i * src_pitch, w*bpp);
+		GLAMOStatEnd(pGlamo, GLAMO_STAT_DOWNLOAD, w * h, 0);
+		return TRUE;
 	}
 
+	/* Wait for blits to the source, including staged uploads. */
+	GLAMOPixmapWait(pGlamo, pSrc);
+
+	src = pGlamo->exa->memoryBase + GLAMOPixmapOffset(pSrc) +
+						x*bpp + y*src_pitch;
+
+	GLAMOTransferRect(pGlamo->download_row, (CARD8 *)dst, dst_pitch,
+			  src, src_pitch, w*bpp, h);
+
+	GLAMOStatEnd(pGlamo, GLAMO_STAT_DOWNLOAD, w * h, w * h * bpp);
+
 	return TRUE;
 }
 
@@ -511,5 +2461,14 @@ GLAMOExaWaitMarker (ScreenPtr pScreen, int marker)
 	ScrnInfoPtr pScrn = xf86Screens[pScreen->myNum];
 	GlamoPtr pGlamo = GlamoPTR(pScrn);
 
+	/*
+	 * Driver pixmaps wait for their own fence in PrepareAccess, so
+	 * only get the queued commands going here.
+	 */
+	if (pGlamo->driver_pixmaps) {
+		GLAMOFlushCMDQCache(pGlamo, 1);
+		return;
+	}
+
 	GLAMOEngineWait(pGlamo, GLAMO_ENGINE_ALL);
 }
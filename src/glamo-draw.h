@@ -28,19 +28,71 @@
 
 void GLAMOWaitIdle(GlamoPtr *pGlamo);
 
-#define GLAMO_TRACE_FALL 1
+/* Raster operations for COMMAND2, indexed by the X11 GX* function. */
+extern const CARD8 GLAMOSolidRop[16];
+extern const CARD8 GLAMOBltRop[16];
+
+Bool
+GLAMOExaPrepareSolid(PixmapPtr      pPixmap,
+		     int            alu,
+		     Pixel          planemask,
+		     Pixel          fg);
+
+void
+GLAMOExaSolid(PixmapPtr pPixmap, int x1, int y1, int x2, int y2);
+
+void
+GLAMOExaDoneSolid(PixmapPtr pPixmap);
+
+/* Queue one blit using the source and destination currently programmed. */
+void
+GLAMOExaEmitCopy(GlamoPtr pGlamo, int srcX, int srcY, int dstX, int dstY,
+		 int width, int height);
+
+/* Program the source, or source, destination and raster op, of blits. */
+void
+GLAMOExaSetSrc(GlamoPtr pGlamo, CARD32 offset, int pitch);
+
+void
+GLAMOExaSetupBlt(GlamoPtr pGlamo, CARD32 src_offset, int src_pitch,
+		 PixmapPtr pDst, CARD8 rop);
+
+void
+GLAMOExaUploadRingInit(GlamoPtr pGlamo);
+
+/* Queue the copy of a block of VRAM to a place not overlapping it. */
+void
+GLAMOExaMoveVRAM(GlamoPtr pGlamo, CARD32 dst, CARD32 src, int size);
+
+/*
+ * Largest rectangle side and pitch in bytes the 2D engine is known to
+ * handle.  Pixmaps up to GLAMO_MAX_PIXMAP_SIZE pixels on a side are drawn
+ * in pieces within these limits, as long as their pitch fits.
+ */
+#define GLAMO_HW_MAX_COORD	640
+#define GLAMO_HW_MAX_PITCH	2047
+#define GLAMO_MAX_PIXMAP_SIZE	2048
+
+Bool
+GLAMOPixmapIsLarge(PixmapPtr pPix);
+
+/* Largest coordinate the 2D clip registers take, exclusive. */
+#define GLAMO_HW_CLIP_MAX	2048
+
+int
+GLAMOExaSetClip(GlamoPtr pGlamo, int x1, int y1, int x2, int y2);
+
+int
+GLAMOExaResetClip(GlamoPtr pGlamo);
+
 #define GLAMO_TRACE_DRAW 1
 
-#if GLAMO_TRACE_FALL
-#define GLAMO_FALLBACK(x)			\
-do {					\
-	ErrorF("%s: ", __FUNCTION__);	\
-	ErrorF x;			\
-	return FALSE;			\
+/* Counted and logged now and then by glamo-stats.c */
+#define GLAMO_FALLBACK(pGlamo, reason)		\
+do {						\
+	GLAMOStatFallback(pGlamo, reason);	\
+	return FALSE;				\
 } while (0)
-#else
-#define GLAMO_FALLBACK(x) return FALSE
-#endif
 
 #if GLAMO_TRACE_DRAW
 #define ENTER_DRAW(pix) GLAMOEnterDraw(pix, __FUNCTION__)
@@ -68,6 +68,9 @@ GlamoPreInit(ScrnInfoPtr pScrn, int flags);
 static Bool
 GlamoScreenInit(int Index, ScreenPtr pScreen, int argc, char **argv);
 
+static Bool
+GlamoCreateScreenResources(ScreenPtr pScreen);
+
 static Bool
 GlamoCloseScreen(int scrnIndex, ScreenPtr pScreen);
 
@@ -111,11 +114,27 @@ typedef enum {
 	OPTION_SHADOW_FB,
     OPTION_DEVICE,
 	OPTION_DEBUG,
+	OPTION_HW_CLIP,
+	OPTION_DRIVER_PIXMAPS,
+	OPTION_STATS_TIMING,
+	OPTION_CPU_SOLID_PIXELS,
+	OPTION_CPU_COPY_PIXELS,
+	OPTION_READBACK_CACHE,
+	OPTION_DITHER,
+	OPTION_SW_CURSOR,
 } GlamoOpts;
 
 static const OptionInfoRec GlamoOptions[] = {
 	{ OPTION_SHADOW_FB,	"ShadowFB",	OPTV_BOOLEAN,	{0},	FALSE },
 	{ OPTION_DEBUG,		"debug",	OPTV_BOOLEAN,	{0},	FALSE },
+	{ OPTION_HW_CLIP,	"HWClip",	OPTV_BOOLEAN,	{0},	FALSE },
+	{ OPTION_DRIVER_PIXMAPS, "DriverPixmaps", OPTV_BOOLEAN,	{0},	FALSE },
+	{ OPTION_STATS_TIMING,	"StatsTiming",	OPTV_BOOLEAN,	{0},	FALSE },
+	{ OPTION_CPU_SOLID_PIXELS, "CPUSolidPixels", OPTV_INTEGER, {0},	FALSE },
+	{ OPTION_CPU_COPY_PIXELS, "CPUCopyPixels", OPTV_INTEGER,	{0},	FALSE },
+	{ OPTION_READBACK_CACHE, "ReadbackCache", OPTV_INTEGER,	{0},	FALSE },
+	{ OPTION_DITHER,	"Dither",	OPTV_BOOLEAN,	{0},	FALSE },
+	{ OPTION_SW_CURSOR,	"SWCursor",	OPTV_BOOLEAN,	{0},	FALSE },
 	{ -1,			NULL,		OPTV_NONE,	{0},	FALSE }
 };
 
@@ -130,6 +149,7 @@ static const char *fbSymbols[] = {
 static const char *shadowSymbols[] = {
 	"shadowAdd",
 	"shadowInit",
+	"shadowRemove",
 	"shadowSetup",
 	"shadowUpdatePacked",
 	"shadowUpdatePackedWeak",
@@ -179,6 +199,13 @@ static const char *exaSymbols[] = {
     NULL
 };
 
+static const char *ramdacSymbols[] = {
+    "xf86CreateCursorInfoRec",
+    "xf86DestroyCursorInfoRec",
+    "xf86InitCursor",
+    NULL
+};
+
 
 #ifdef XFree86LOADER
 
@@ -209,7 +236,8 @@ GlamoSetup(pointer module, pointer opts, int *errmaj, int *errmin)
 		setupDone = TRUE;
 		xf86AddDriver(&Glamo, module, 0);
 		LoaderRefSymLists(fbSymbols,
-				  shadowSymbols, fbdevHWSymbols, exaSymbols, NULL);
+				  shadowSymbols, fbdevHWSymbols, exaSymbols,
+				  ramdacSymbols, NULL);
 		return (pointer)1;
 	} else {
 		if (errmaj) *errmaj = LDR_ONCEONLY;
@@ -329,7 +357,7 @@ static Bool
 GlamoPreInit(ScrnInfoPtr pScrn, int flags)
 {
     GlamoPtr pGlamo;
-    int default_depth, fbbpp;
+    int default_depth, fbbpp, kb;
     rgb weight_defaults = {0, 0, 0};
     Gamma gamma_defaults = {0.0, 0.0, 0.0};
     char *fb_device;
@@ -416,11 +444,45 @@ GlamoPreInit(ScrnInfoPtr pScrn, int flags)
     memcpy(pGlamo->Options, GlamoOptions, sizeof(GlamoOptions));
     xf86ProcessOptions(pScrn->scrnIndex, pGlamo->pEnt->device->options, pGlamo->Options);
 
-    /* use shadow framebuffer by default */
-    pGlamo->shadowFB = xf86ReturnOptValBool(pGlamo->Options, OPTION_SHADOW_FB, TRUE);
+    /* a screen in system memory is out of reach of the blitter, so opt-in */
+    pGlamo->shadowFB = xf86ReturnOptValBool(pGlamo->Options, OPTION_SHADOW_FB, FALSE);
 
     debug = xf86ReturnOptValBool(pGlamo->Options, OPTION_DEBUG, FALSE);
 
+    /*
+     * The clip registers' enable and edge semantics are guessed, see
+     * GLAMOExaSetClip, so clipping in hardware stays opt-in until they
+     * have been confirmed on the chip.
+     */
+    pGlamo->hw_clip = xf86ReturnOptValBool(pGlamo->Options, OPTION_HW_CLIP, FALSE);
+
+    pGlamo->driver_pixmaps = xf86ReturnOptValBool(pGlamo->Options,
+                                                  OPTION_DRIVER_PIXMAPS, TRUE);
+
+    /* timing every operation costs two system calls, so this is opt-in */
+    pGlamo->stats_timing = xf86ReturnOptValBool(pGlamo->Options,
+                                                OPTION_STATS_TIMING, FALSE);
+
+    /* crossover of the CPU and blitter costs, measured unless set */
+    pGlamo->cost[GLAMO_COST_SOLID].cpu_max = -1;
+    pGlamo->cost[GLAMO_COST_COPY].cpu_max = -1;
+    xf86GetOptValInteger(pGlamo->Options, OPTION_CPU_SOLID_PIXELS,
+                         &pGlamo->cost[GLAMO_COST_SOLID].cpu_max);
+    xf86GetOptValInteger(pGlamo->Options, OPTION_CPU_COPY_PIXELS,
+                         &pGlamo->cost[GLAMO_COST_COPY].cpu_max);
+
+    /* kB of system memory for copies of pixmaps the CPU reads, 0 is off */
+    if (xf86GetOptValInteger(pGlamo->Options, OPTION_READBACK_CACHE, &kb) &&
+        kb > 0)
+        pGlamo->readback_budget = kb * 1024;
+
+    /* dither images converted to 16bpp, off like in pixman */
+    pGlamo->dither = xf86ReturnOptValBool(pGlamo->Options, OPTION_DITHER,
+                                          FALSE);
+
+    pGlamo->hw_cursor = !xf86ReturnOptValBool(pGlamo->Options,
+                                              OPTION_SW_CURSOR, FALSE);
+
     /* First approximation, may be refined in ScreenInit */
     pScrn->displayWidth = pScrn->virtualX;
 
@@ -435,6 +497,22 @@ GlamoPreInit(ScrnInfoPtr pScrn, int flags)
     }
     xf86LoaderReqSymLists(fbSymbols, NULL);
 
+    if (pGlamo->shadowFB) {
+        if (xf86LoadSubModule(pScrn, "shadow") == NULL) {
+            GlamoFreeRec(pScrn);
+            return FALSE;
+        }
+        xf86LoaderReqSymLists(shadowSymbols, NULL);
+    }
+
+    if (pGlamo->hw_cursor) {
+        if (xf86LoadSubModule(pScrn, "ramdac") == NULL) {
+            GlamoFreeRec(pScrn);
+            return FALSE;
+        }
+        xf86LoaderReqSymLists(ramdacSymbols, NULL);
+    }
+
     TRACE_EXIT("PreInit");
     return TRUE;
 }
@@ -488,7 +566,21 @@ GlamoScreenInit(int scrnIndex, ScreenPtr pScreen, int argc, char **argv)
 
     pGlamo->fbstart = pGlamo->fbmem + pGlamo->fboff;
 
-    ret = fbScreenInit(pScreen, pGlamo->fbstart, pScrn->virtualX,
+    /* as large as the scanout buffer, which RandR may reshape */
+    if (pGlamo->shadowFB) {
+        pGlamo->shadow = xcalloc(1, max(pScrn->virtualX * pScrn->virtualY,
+                                        pScrn->displayWidth * pScrn->virtualY) *
+                                    pScrn->bitsPerPixel / 8);
+        if (!pGlamo->shadow) {
+            xf86DrvMsg(scrnIndex, X_ERROR,
+                       "Failed to allocate shadow framebuffer\n");
+            return FALSE;
+        }
+    }
+
+    ret = fbScreenInit(pScreen,
+                       pGlamo->shadowFB ? pGlamo->shadow : pGlamo->fbstart,
+                       pScrn->virtualX,
                        pScrn->virtualY, pScrn->xDpi, pScrn->yDpi,
                        pScrn->displayWidth,  pScrn->bitsPerPixel);
     if (!ret)
@@ -512,6 +604,18 @@ GlamoScreenInit(int scrnIndex, ScreenPtr pScreen, int argc, char **argv)
         xf86DrvMsg(pScrn->scrnIndex, X_WARNING,
                    "Render extension initialisation failed\n");
 
+    if (pGlamo->shadowFB) {
+        if (!shadowSetup(pScreen)) {
+            xf86DrvMsg(scrnIndex, X_ERROR,
+                       "Shadow framebuffer initialization failed\n");
+            return FALSE;
+        }
+
+        REGION_NULL(pScreen, &pGlamo->shadow_stale);
+        pGlamo->CreateScreenResources = pScreen->CreateScreenResources;
+        pScreen->CreateScreenResources = GlamoCreateScreenResources;
+    }
+
         /* map in the registers */
         pGlamo->reg_base = xf86MapVidMem(pScreen->myNum, VIDMEM_MMIO, 0x8000000, 0x2400);
 
@@ -535,6 +639,10 @@ GlamoScreenInit(int scrnIndex, ScreenPtr pScreen, int argc, char **argv)
         /* software cursor */
         miDCInitialize(pScreen, xf86GetPointerScreenFuncs());
 
+        /* hardware cursor, for the cursors the LCD can show */
+        if (pGlamo->hw_cursor && !GLAMOCursorInit(pScreen))
+            xf86DrvMsg(scrnIndex, X_INFO, "Using the software cursor\n");
+
         /* colormap */
         if (!miCreateDefColormap(pScreen)) {
             xf86DrvMsg(scrnIndex, X_ERROR,
@@ -567,17 +675,49 @@ GlamoScreenInit(int scrnIndex, ScreenPtr pScreen, int argc, char **argv)
     return TRUE;
 }
 
+/* Software rendering to the screen goes to the shadow, see glamo-shadow.c */
+static Bool
+GlamoCreateScreenResources(ScreenPtr pScreen)
+{
+    ScrnInfoPtr pScrn = xf86Screens[pScreen->myNum];
+    GlamoPtr pGlamo = GlamoPTR(pScrn);
+    Bool ret;
+
+    pScreen->CreateScreenResources = pGlamo->CreateScreenResources;
+    ret = pScreen->CreateScreenResources(pScreen);
+    pScreen->CreateScreenResources = GlamoCreateScreenResources;
+
+    if (!ret)
+        return FALSE;
+
+    return shadowAdd(pScreen, pScreen->GetScreenPixmap(pScreen),
+                     GLAMOShadowUpdate, NULL, 0, NULL);
+}
+
 static Bool
 GlamoCloseScreen(int scrnIndex, ScreenPtr pScreen)
 {
     ScrnInfoPtr pScrn = xf86Screens[scrnIndex];
     GlamoPtr pGlamo = GlamoPTR(pScrn);
 
+    if (pGlamo->shadow)
+        shadowRemove(pScreen, pScreen->GetScreenPixmap(pScreen));
+
+    GLAMOCursorFini(pScreen);
+    GLAMODrawFini(pScreen);
+
     fbdevHWRestore(pScrn);
     fbdevHWUnmapVidmem(pScrn);
     pScrn->vtSema = FALSE;
 
-    pScreen->CreateScreenResources = pGlamo->CreateScreenResources;
+    if (pGlamo->shadow) {
+        REGION_UNINIT(pScreen, &pGlamo->shadow_stale);
+        xfree(pGlamo->shadow);
+        pGlamo->shadow = NULL;
+    }
+
+    if (pGlamo->shadowFB)
+        pScreen->CreateScreenResources = pGlamo->CreateScreenResources;
     pScreen->CloseScreen = pGlamo->CloseScreen;
     return (*pScreen->CloseScreen)(scrnIndex, pScreen);
 }
@@ -0,0 +1,1190 @@
+/*
+ * Copyright  2007 OpenMoko, Inc.
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation, and
+ * that the name of the copyright holders not be used in advertising or
+ * publicity pertaining to distribution of the software without specific,
+ * written prior permission.  The copyright holders make no representations
+ * about the suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO
+ * EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE,
+ * DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER
+ * TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+ * OF THIS SOFTWARE.
+ */
+
+/*
+ * GC wrapper accelerating core text, glyph blits, small XYBitmap images and
+ * tiled or stippled rectangle fills.  EXA has no hooks for 1bpp sources and
+ * fills tiles with one copy per tile, so the GC ops are wrapped on top of
+ * EXA's, the way the damage layer does it.
+ * Everything that can't be done by the blitter is passed on unchanged.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+#include "glamo-log.h"
+#include "glamo.h"
+#include "glamo-regs.h"
+#include "glamo-cmdq.h"
+#include "glamo-draw.h"
+
+#include "gcstruct.h"
+#include "dixfontstr.h"
+#include "dixfont.h"
+#include "servermd.h"
+#include "damage.h"
+
+/* Largest XYBitmap PutImage done by the blitter, in cells per direction. */
+#define GLAMO_BITMAP_MAX_CELLS	2
+
+typedef struct {
+	GCFuncs *funcs;
+	GCOps *ops;
+} GlamoGCPrivRec, *GlamoGCPrivPtr;
+
+static int GLAMOGCPrivateKeyIndex;
+static DevPrivateKey GLAMOGCPrivateKey = &GLAMOGCPrivateKeyIndex;
+
+#define GLAMOGetGCPriv(pGC) ((GlamoGCPrivPtr) \
+	dixLookupPrivate(&(pGC)->devPrivates, GLAMOGCPrivateKey))
+
+static GCFuncs GLAMOGCFuncs;
+static GCOps GLAMOGCOps;
+
+#define GLAMO_GC_FUNC_PROLOGUE(pGC)				\
+	GlamoGCPrivPtr pGCPriv = GLAMOGetGCPriv(pGC);		\
+	(pGC)->funcs = pGCPriv->funcs;				\
+	if (pGCPriv->ops)					\
+		(pGC)->ops = pGCPriv->ops
+
+#define GLAMO_GC_FUNC_EPILOGUE(pGC)				\
+	pGCPriv->funcs = (pGC)->funcs;				\
+	(pGC)->funcs = &GLAMOGCFuncs;				\
+	if (pGCPriv->ops) {					\
+		pGCPriv->ops = (pGC)->ops;			\
+		(pGC)->ops = &GLAMOGCOps;			\
+	}
+
+#define GLAMO_GC_OP_PROLOGUE(pGC)				\
+	GlamoGCPrivPtr pGCPriv = GLAMOGetGCPriv(pGC);		\
+	GCFuncs *oldFuncs = (pGC)->funcs;			\
+	(pGC)->funcs = pGCPriv->funcs;				\
+	(pGC)->ops = pGCPriv->ops
+
+#define GLAMO_GC_OP_EPILOGUE(pGC)				\
+	pGCPriv->funcs = (pGC)->funcs;				\
+	(pGC)->funcs = oldFuncs;				\
+	pGCPriv->ops = (pGC)->ops;				\
+	(pGC)->ops = &GLAMOGCOps
+
+/*
+ * Returns the pixmap backing the drawable if it is in VRAM and the GC state
+ * can be handled by the blitter, NULL otherwise.
+ */
+static PixmapPtr
+GLAMOGCGetPixmap(DrawablePtr pDrawable, GCPtr pGC, Bool checkAlu,
+		 int *xoff, int *yoff)
+{
+	ScrnInfoPtr pScrn = xf86Screens[pDrawable->pScreen->myNum];
+	GlamoPtr pGlamo = GlamoPTR(pScrn);
+	PixmapPtr pPix;
+	FbBits mask;
+
+	if (pDrawable->bitsPerPixel != 16 || !pGlamo->mono_cache.area)
+		return NULL;
+
+	mask = FbFullMask(16);
+	if ((pGC->planemask & mask) != mask)
+		return NULL;
+
+	if (checkAlu && (pGC->alu != GXcopy || pGC->fillStyle != FillSolid))
+		return NULL;
+
+	if (pDrawable->type == DRAWABLE_WINDOW) {
+		pPix = pDrawable->pScreen->GetWindowPixmap((WindowPtr) pDrawable);
+#ifdef COMPOSITE
+		*xoff = -pPix->screen_x;
+		*yoff = -pPix->screen_y;
+#else
+		*xoff = 0;
+		*yoff = 0;
+#endif
+	} else {
+		pPix = (PixmapPtr) pDrawable;
+		*xoff = 0;
+		*yoff = 0;
+	}
+
+	/* The GC paths don't split their blits. */
+	if (GLAMOPixmapIsLarge(pPix) || !GLAMOPixmapInVRAM(pGlamo, pPix))
+		return NULL;
+
+	return pPix;
+}
+
+static void
+GLAMOGCSetRop(GlamoPtr pGlamo, CARD8 rop)
+{
+	RING_LOCALS;
+
+	BEGIN_CMDQ(2);
+	OUT_REG(GLAMO_REG_2D_COMMAND2, rop << 8);
+	END_CMDQ();
+}
+
+#if BITMAP_BIT_ORDER != LSBFirst
+static CARD8
+GLAMOReverseByte(CARD8 b)
+{
+	b = (b >> 4) | (b << 4);
+	b = ((b & 0xcc) >> 2) | ((b & 0x33) << 2);
+	return ((b & 0xaa) >> 1) | ((b & 0x55) << 1);
+}
+#endif
+
+/*
+ * Convert rows of a bitmap in server bit order into the cache layout, where
+ * bit x of a row is pixel x.
+ */
+static void
+GLAMOLoadBitmap(CARD32 *rows, const CARD8 *src, int stride, int leftPad,
+		int width, int height)
+{
+	int first = leftPad >> 3, nbytes = ((leftPad & 7) + width + 7) >> 3;
+	CARD32 mask = width < 32 ? ((CARD32) 1 << width) - 1 : ~0;
+	unsigned long long row;
+	int x, y;
+
+	for (y = 0; y < height; y++) {
+		row = 0;
+		for (x = 0; x < nbytes; x++) {
+#if BITMAP_BIT_ORDER == LSBFirst
+			row |= (unsigned long long) src[first + x] << (x * 8);
+#else
+			row |= (unsigned long long)
+				GLAMOReverseByte(src[first + x]) << (x * 8);
+#endif
+		}
+		rows[y] = (row >> (leftPad & 7)) & mask;
+		src += stride;
+	}
+}
+
+/*
+ * Blit a cell to (x, y) in drawable coordinates, clipped to pClip.  When the
+ * cell is split over several clip boxes and hardware clipping is enabled,
+ * the blit is set up once and only the clip rectangle and the kick are
+ * emitted per box, instead of a complete pre-clipped blit.
+ */
+static void
+GLAMOGCBltCell(GlamoPtr pGlamo, RegionPtr pClip, GlamoMonoCellPtr cell,
+	       int x, int y, int width, int height, int xoff, int yoff)
+{
+	BoxPtr pbox = REGION_RECTS(pClip);
+	int nbox = REGION_NUM_RECTS(pClip);
+	int i, n = 0, words;
+	int x1, y1, x2, y2;
+	RING_LOCALS;
+
+	if (pGlamo->hw_clip) {
+		for (i = 0; i < nbox && n < 2; i++)
+			if (max(x, pbox[i].x1) < min(x + width, pbox[i].x2) &&
+			    max(y, pbox[i].y1) < min(y + height, pbox[i].y2))
+				n++;
+	}
+
+	if (n < 2) {
+		pGlamo->hw_clip_words_saved -= GLAMOExaResetClip(pGlamo);
+		for (; nbox--; pbox++) {
+			x1 = max(x, pbox->x1);
+			y1 = max(y, pbox->y1);
+			x2 = min(x + width, pbox->x2);
+			y2 = min(y + height, pbox->y2);
+			if (x1 >= x2 || y1 >= y2)
+				continue;
+			GLAMOExaEmitCopy(pGlamo,
+					 cell->x + x1 - x, cell->y + y1 - y,
+					 x1 + xoff, y1 + yoff,
+					 x2 - x1, y2 - y1);
+		}
+		return;
+	}
+
+	BEGIN_CMDQ(12);
+	OUT_REG(GLAMO_REG_2D_SRC_X, cell->x);
+	OUT_REG(GLAMO_REG_2D_SRC_Y, cell->y);
+	OUT_REG(GLAMO_REG_2D_DST_X, x + xoff);
+	OUT_REG(GLAMO_REG_2D_DST_Y, y + yoff);
+	OUT_REG(GLAMO_REG_2D_RECT_WIDTH, width);
+	OUT_REG(GLAMO_REG_2D_RECT_HEIGHT, height);
+	END_CMDQ();
+	words = 12;
+
+	for (n = 0; nbox--; pbox++) {
+		if (max(x, pbox->x1) >= min(x + width, pbox->x2) ||
+		    max(y, pbox->y1) >= min(y + height, pbox->y2))
+			continue;
+		words += GLAMOExaSetClip(pGlamo, pbox->x1 + xoff,
+					 pbox->y1 + yoff, pbox->x2 + xoff,
+					 pbox->y2 + yoff);
+		BEGIN_CMDQ(2);
+		OUT_REG(GLAMO_REG_2D_COMMAND3, 0);
+		END_CMDQ();
+		words += 2;
+		n++;
+	}
+
+	/* A pre-clipped blit is 14 words per box. */
+	pGlamo->hw_clip_words_saved += 14 * n - words;
+}
+
+/*
+ * Get a cell, starting a new batch if all candidates are in use by the
+ * queued commands.
+ */
+static GlamoMonoCellPtr
+GLAMOGCGetCell(GlamoPtr pGlamo, const CARD32 *rows, int width, int height,
+	       CARD16 fg, CARD16 bg)
+{
+	GlamoMonoCellPtr cell;
+
+	cell = GLAMOMonoCacheGet(pGlamo, rows, width, height, fg, bg);
+	if (!cell) {
+		GLAMOFlushCMDQCache(pGlamo, 1);
+		GLAMOMonoCacheNewBatch(pGlamo);
+		cell = GLAMOMonoCacheGet(pGlamo, rows, width, height, fg, bg);
+	}
+
+	return cell;
+}
+
+/*
+ * Note the part of the pixmap a request drew to, a box in screen
+ * coordinates clipped by the GC, for the readback cache.
+ */
+static void
+GLAMOGCDirty(GlamoPtr pGlamo, GCPtr pGC, PixmapPtr pPix, BoxPtr pBox,
+	     int xoff, int yoff)
+{
+	BoxPtr clip = REGION_EXTENTS(pGC->pScreen, pGC->pCompositeClip);
+	int x1 = max(pBox->x1, clip->x1), y1 = max(pBox->y1, clip->y1);
+	int x2 = min(pBox->x2, clip->x2), y2 = min(pBox->y2, clip->y2);
+
+	if (x1 < x2 && y1 < y2)
+		GLAMOPixmapDirty(pGlamo, pPix, x1 + xoff, y1 + yoff,
+				 x2 + xoff, y2 + yoff);
+}
+
+static void
+GLAMOGCDamage(DrawablePtr pDrawable, GCPtr pGC, PixmapPtr pPix, BoxPtr pBox,
+	      int xoff, int yoff)
+{
+	ScreenPtr pScreen = pDrawable->pScreen;
+	RegionRec region;
+
+	REGION_INIT(pScreen, &region, pBox, 1);
+	REGION_INTERSECT(pScreen, &region, &region, pGC->pCompositeClip);
+	DamageDamageRegion(pDrawable, &region);
+	if (pDrawable != &pPix->drawable) {
+		REGION_TRANSLATE(pScreen, &region, xoff, yoff);
+		DamageDamageRegion(&pPix->drawable, &region);
+	}
+	REGION_UNINIT(pScreen, &region);
+}
+
+/*
+ * Draw glyphs with the blitter.  Opaque text whose glyphs stay within their
+ * own cell is blitted with fg/bg expanded glyphs on top of the background.
+ * Everything else uses two passes: the glyph shape is cleared with
+ * GXandInverted and the foreground is or'ed in.
+ */
+static Bool
+GLAMOGlyphBlt(DrawablePtr pDrawable, GCPtr pGC, int x, int y,
+	      unsigned int nglyph, CharInfoPtr *ppci, Bool image)
+{
+	ScrnInfoPtr pScrn = xf86Screens[pDrawable->pScreen->myNum];
+	GlamoPtr pGlamo = GlamoPTR(pScrn);
+	FontPtr pFont = pGC->font;
+	RegionPtr pClip = pGC->pCompositeClip;
+	CARD16 fg = pGC->fgPixel, bg = pGC->bgPixel;
+	CARD16 pass_fg[2], pass_bg[2];
+	CARD8 pass_rop[2];
+	CARD32 rows[GLAMO_MONO_CELL_SIZE];
+	GlamoMonoCellPtr cell;
+	ExtentInfoRec info;
+	PixmapPtr pPix;
+	BoxRec extents, back, *pbox;
+	CharInfoPtr pci;
+	Bool opaque = image;
+	int xoff, yoff, npass, pass, gx, gw, gh, nbox, words;
+	unsigned int i;
+
+	for (i = 0; i < nglyph; i++) {
+		pci = ppci[i];
+		if (GLYPHWIDTHPIXELS(pci) > GLAMO_MONO_CELL_SIZE ||
+		    GLYPHHEIGHTPIXELS(pci) > GLAMO_MONO_CELL_SIZE)
+			return FALSE;
+		if (pci->metrics.leftSideBearing < 0 ||
+		    pci->metrics.rightSideBearing > pci->metrics.characterWidth ||
+		    pci->metrics.ascent > FONTASCENT(pFont) ||
+		    pci->metrics.descent > FONTDESCENT(pFont))
+			opaque = FALSE;
+	}
+
+	pPix = GLAMOGCGetPixmap(pDrawable, pGC, !image, &xoff, &yoff);
+	if (!pPix)
+		return FALSE;
+	GLAMOStatBegin(pGlamo, GLAMO_STAT_GLYPHS);
+
+	x += pDrawable->x;
+	y += pDrawable->y;
+
+	QueryGlyphExtents(pFont, ppci, nglyph, &info);
+	extents.x1 = x + info.overallLeft;
+	extents.x2 = x + info.overallRight;
+	extents.y1 = y - info.overallAscent;
+	extents.y2 = y + info.overallDescent;
+
+	if (image) {
+		back.x1 = x + min(info.overallWidth, 0);
+		back.x2 = x + max(info.overallWidth, 0);
+		back.y1 = y - FONTASCENT(pFont);
+		back.y2 = y + FONTDESCENT(pFont);
+		extents.x1 = min(extents.x1, back.x1);
+		extents.x2 = max(extents.x2, back.x2);
+		extents.y1 = min(extents.y1, back.y1);
+		extents.y2 = max(extents.y2, back.y2);
+
+		GLAMOExaPrepareSolid(pPix, GXcopy, FB_ALLONES, bg);
+		pbox = REGION_RECTS(pClip);
+		nbox = REGION_NUM_RECTS(pClip);
+		for (; nbox--; pbox++) {
+			if (max(back.x1, pbox->x1) >= min(back.x2, pbox->x2) ||
+			    max(back.y1, pbox->y1) >= min(back.y2, pbox->y2))
+				continue;
+			GLAMOExaSolid(pPix,
+				      max(back.x1, pbox->x1) + xoff,
+				      max(back.y1, pbox->y1) + yoff,
+				      min(back.x2, pbox->x2) + xoff,
+				      min(back.y2, pbox->y2) + yoff);
+		}
+		GLAMOExaDoneSolid(pPix);
+	}
+
+	if (opaque) {
+		npass = 1;
+		pass_rop[0] = GLAMOBltRop[GXcopy];
+		pass_fg[0] = fg;
+		pass_bg[0] = bg;
+	} else {
+		npass = 0;
+		if (fg != 0xffff) {
+			pass_rop[npass] = GLAMOBltRop[GXandInverted];
+			pass_fg[npass] = 0xffff;
+			pass_bg[npass++] = 0;
+		}
+		if (fg != 0) {
+			pass_rop[npass] = GLAMOBltRop[GXor];
+			pass_fg[npass] = fg;
+			pass_bg[npass++] = 0;
+		}
+	}
+
+	GLAMOMonoCacheNewBatch(pGlamo);
+	GLAMOExaSetupBlt(pGlamo, pGlamo->mono_cache.offset,
+			pGlamo->mono_cache.pitch, pPix, pass_rop[0]);
+
+	for (pass = 0; pass < npass; pass++) {
+		if (pass)
+			GLAMOGCSetRop(pGlamo, pass_rop[pass]);
+		gx = x;
+		for (i = 0; i < nglyph; i++) {
+			pci = ppci[i];
+			gw = GLYPHWIDTHPIXELS(pci);
+			gh = GLYPHHEIGHTPIXELS(pci);
+			if (gw && gh) {
+				GLAMOLoadBitmap(rows, FONTGLYPHBITS(NULL, pci),
+						GLYPHWIDTHBYTESPADDED(pci), 0,
+						gw, gh);
+				cell = GLAMOGCGetCell(pGlamo, rows, gw, gh,
+						      pass_fg[pass],
+						      pass_bg[pass]);
+				GLAMOGCBltCell(pGlamo, pClip, cell,
+					       gx + pci->metrics.leftSideBearing,
+					       y - pci->metrics.ascent,
+					       gw, gh, xoff, yoff);
+			}
+			gx += pci->metrics.characterWidth;
+		}
+	}
+
+	words = GLAMOExaResetClip(pGlamo);
+	if (words) {
+		pGlamo->hw_clip_words_saved -= words;
+		pGlamo->hw_clip_requests++;
+	}
+	GLAMOGCDirty(pGlamo, pGC, pPix, &extents, xoff, yoff);
+	GLAMOPixmapFence(pGlamo, pPix);
+	GLAMOFlushCMDQCache(pGlamo, 1);
+	exaMarkSync(pDrawable->pScreen);
+
+	if (extents.x1 < extents.x2 && extents.y1 < extents.y2) {
+		GLAMOGCDamage(pDrawable, pGC, pPix, &extents, xoff, yoff);
+		GLAMOStatEnd(pGlamo, GLAMO_STAT_GLYPHS,
+			     (extents.x2 - extents.x1) *
+			     (extents.y2 - extents.y1), 0);
+	} else
+		GLAMOStatEnd(pGlamo, GLAMO_STAT_GLYPHS, 0, 0);
+
+	return TRUE;
+}
+
+static Bool
+GLAMOPutBitmap(DrawablePtr pDrawable, GCPtr pGC, int x, int y, int w, int h,
+	       int leftPad, char *pBits)
+{
+	ScrnInfoPtr pScrn = xf86Screens[pDrawable->pScreen->myNum];
+	GlamoPtr pGlamo = GlamoPTR(pScrn);
+	CARD32 rows[GLAMO_MONO_CELL_SIZE];
+	GlamoMonoCellPtr cell;
+	PixmapPtr pPix;
+	BoxRec extents;
+	int xoff, yoff, stride, cx, cy, cw, ch, words;
+
+	if (w > GLAMO_BITMAP_MAX_CELLS * GLAMO_MONO_CELL_SIZE ||
+	    h > GLAMO_BITMAP_MAX_CELLS * GLAMO_MONO_CELL_SIZE ||
+	    pGC->alu != GXcopy)
+		return FALSE;
+
+	pPix = GLAMOGCGetPixmap(pDrawable, pGC, FALSE, &xoff, &yoff);
+	if (!pPix)
+		return FALSE;
+	GLAMOStatBegin(pGlamo, GLAMO_STAT_BITMAP);
+
+	x += pDrawable->x;
+	y += pDrawable->y;
+	stride = BitmapBytePad(w + leftPad);
+
+	GLAMOMonoCacheNewBatch(pGlamo);
+	GLAMOExaSetupBlt(pGlamo, pGlamo->mono_cache.offset,
+			pGlamo->mono_cache.pitch, pPix, GLAMOBltRop[GXcopy]);
+
+	for (cy = 0; cy < h; cy += GLAMO_MONO_CELL_SIZE) {
+		ch = min(h - cy, GLAMO_MONO_CELL_SIZE);
+		for (cx = 0; cx < w; cx += GLAMO_MONO_CELL_SIZE) {
+			cw = min(w - cx, GLAMO_MONO_CELL_SIZE);
+			GLAMOLoadBitmap(rows, (CARD8 *) pBits + cy * stride,
+					stride, leftPad + cx, cw, ch);
+			cell = GLAMOGCGetCell(pGlamo, rows, cw, ch,
+					      pGC->fgPixel, pGC->bgPixel);
+			GLAMOGCBltCell(pGlamo, pGC->pCompositeClip, cell,
+				       x + cx, y + cy, cw, ch, xoff, yoff);
+		}
+	}
+
+	words = GLAMOExaResetClip(pGlamo);
+	if (words) {
+		pGlamo->hw_clip_words_saved -= words;
+		pGlamo->hw_clip_requests++;
+	}
+	extents.x1 = x;
+	extents.y1 = y;
+	extents.x2 = x + w;
+	extents.y2 = y + h;
+	GLAMOGCDirty(pGlamo, pGC, pPix, &extents, xoff, yoff);
+	GLAMOPixmapFence(pGlamo, pPix);
+	GLAMOFlushCMDQCache(pGlamo, 1);
+	exaMarkSync(pDrawable->pScreen);
+
+	GLAMOGCDamage(pDrawable, pGC, pPix, &extents, xoff, yoff);
+	GLAMOStatEnd(pGlamo, GLAMO_STAT_BITMAP, w * h, 0);
+
+	return TRUE;
+}
+
+static int
+GLAMOMod(int a, int b)
+{
+	a %= b;
+	return a < 0 ? a + b : a;
+}
+
+/*
+ * Copy the pw x ph pattern at (sx, sy) of the current source into the box,
+ * starting at phase (ox, oy) of the pattern.
+ */
+static void
+GLAMOTileBox(GlamoPtr pGlamo, int sx, int sy, int pw, int ph, BoxPtr pBox,
+	     int ox, int oy, int xoff, int yoff)
+{
+	int x, y, px, py, w, h;
+
+	for (y = pBox->y1, py = oy; y < pBox->y2; y += h, py = 0) {
+		h = min(ph - py, pBox->y2 - y);
+		for (x = pBox->x1, px = ox; x < pBox->x2; x += w, px = 0) {
+			w = min(pw - px, pBox->x2 - x);
+			GLAMOExaEmitCopy(pGlamo, sx + px, sy + py,
+					 x + xoff, y + yoff, w, h);
+		}
+	}
+}
+
+/*
+ * The top left pw x ph pixels of the box hold one period of the pattern.
+ * The rest of the box is filled by copying what is already there, which
+ * doubles the filled area with every blit.
+ */
+static void
+GLAMODoubleBox(GlamoPtr pGlamo, BoxPtr pBox, int pw, int ph,
+	       int xoff, int yoff)
+{
+	int x = pBox->x1 + xoff, y = pBox->y1 + yoff;
+	int width = pBox->x2 - pBox->x1, height = pBox->y2 - pBox->y1;
+	int done, n;
+
+	ph = min(ph, height);
+	for (done = pw; done < width; done += n) {
+		n = min(done, width - done);
+		GLAMOExaEmitCopy(pGlamo, x, y, x + done, y, n, ph);
+	}
+	for (done = ph; done < height; done += n) {
+		n = min(done, height - done);
+		GLAMOExaEmitCopy(pGlamo, x, y, x, y + done, width, n);
+	}
+}
+
+/*
+ * Fill boxes with the pw x ph pattern at (sx, sy) of the source at
+ * src_offset, the pattern origin being at (orgx, orgy).  One period is
+ * copied to the corner of each box, which is then filled by doubling.
+ * Also used for repeating Render sources.
+ */
+void
+GLAMOTileBoxes(GlamoPtr pGlamo, CARD32 src_offset, int src_pitch,
+	       int sx, int sy, int pw, int ph, PixmapPtr pDst,
+	       BoxPtr pbox, int nbox, int orgx, int orgy, int xoff, int yoff)
+{
+	int i;
+
+	GLAMOExaSetupBlt(pGlamo, src_offset, src_pitch, pDst,
+			 GLAMOBltRop[GXcopy]);
+	for (i = 0; i < nbox; i++) {
+		BoxRec first = pbox[i];
+
+		first.x2 = min(first.x2, first.x1 + pw);
+		first.y2 = min(first.y2, first.y1 + ph);
+		GLAMOTileBox(pGlamo, sx, sy, pw, ph, &first,
+			     GLAMOMod(first.x1 - orgx, pw),
+			     GLAMOMod(first.y1 - orgy, ph),
+			     xoff, yoff);
+	}
+
+	GLAMOExaSetSrc(pGlamo, GLAMOPixmapOffset(pDst), pDst->devKind);
+	for (i = 0; i < nbox; i++)
+		GLAMODoubleBox(pGlamo, &pbox[i], pw, ph, xoff, yoff);
+}
+
+/*
+ * Load a stipple and repeat it horizontally and vertically to the largest
+ * multiple of its size that fits into a cache cell, so that one blit covers
+ * as many periods as possible.
+ */
+static Bool
+GLAMOLoadStipple(PixmapPtr pStipple, CARD32 *rows, int *width, int *height)
+{
+	int sw = pStipple->drawable.width, sh = pStipple->drawable.height;
+	CARD32 row;
+	int x, y;
+
+	if (sw > GLAMO_MONO_CELL_SIZE || sh > GLAMO_MONO_CELL_SIZE ||
+	    !pStipple->devPrivate.ptr)
+		return FALSE;
+
+	GLAMOLoadBitmap(rows, pStipple->devPrivate.ptr, pStipple->devKind, 0,
+			sw, sh);
+
+	*width = (GLAMO_MONO_CELL_SIZE / sw) * sw;
+	*height = (GLAMO_MONO_CELL_SIZE / sh) * sh;
+
+	for (y = 0; y < sh; y++) {
+		row = rows[y];
+		for (x = sw; x < *width; x += sw)
+			rows[y] |= row << x;
+	}
+	for (y = sh; y < *height; y++)
+		rows[y] = rows[y - sh];
+
+	return TRUE;
+}
+
+/*
+ * Fill a region in screen coordinates with the tile or stipple of the GC.
+ * Tiles and opaque stipples are copied once per box and the box is then
+ * filled by doubling, so a full screen background takes a dozen blits.
+ * Transparent stipples can't be doubled on the destination and are blitted
+ * across the box in two passes, like transparent text.
+ */
+static Bool
+GLAMOFillRegionPattern(DrawablePtr pDrawable, GCPtr pGC, RegionPtr pRegion)
+{
+	ScrnInfoPtr pScrn = xf86Screens[pDrawable->pScreen->myNum];
+	GlamoPtr pGlamo = GlamoPTR(pScrn);
+	GlamoMonoCachePtr cache = &pGlamo->mono_cache;
+	CARD16 fg = pGC->fgPixel, bg = pGC->bgPixel;
+	CARD32 rows[GLAMO_MONO_CELL_SIZE];
+	CARD32 src_offset;
+	GlamoMonoCellPtr cell;
+	PixmapPtr pPix, pTile = NULL;
+	BoxPtr pbox, extents;
+	int xoff, yoff, orgx, orgy, sx, sy, src_pitch, nbox, i;
+	int pw = 0, ph = 0;
+	unsigned long pixels;
+
+	if (pGC->alu != GXcopy)
+		return FALSE;
+
+	switch (pGC->fillStyle) {
+	case FillTiled:
+		pTile = pGC->tile.pixmap;
+		if (pGC->tileIsPixel || pTile->drawable.bitsPerPixel != 16 ||
+		    pTile == (PixmapPtr) pDrawable)
+			return FALSE;
+		break;
+	case FillStippled:
+	case FillOpaqueStippled:
+		if (!GLAMOLoadStipple(pGC->stipple, rows, &pw, &ph))
+			return FALSE;
+		break;
+	default:
+		return FALSE;
+	}
+
+	/* The tile is moved in first, so it can't push the target out. */
+	if (pTile && (GLAMOPixmapIsLarge(pTile) ||
+		      !GLAMOPixmapInVRAM(pGlamo, pTile)))
+		return FALSE;
+
+	pPix = GLAMOGCGetPixmap(pDrawable, pGC, FALSE, &xoff, &yoff);
+	if (!pPix)
+		return FALSE;
+
+	/* Moving the target in may have pushed the tile out in turn. */
+	if (pTile && (pTile == pPix ||
+		      GLAMOPixmapOffset(pTile) >= pGlamo->exa->memorySize))
+		return FALSE;
+
+	GLAMOStatBegin(pGlamo, GLAMO_STAT_PATTERN_FILL);
+
+	orgx = pGC->patOrg.x + pDrawable->x;
+	orgy = pGC->patOrg.y + pDrawable->y;
+	pbox = REGION_RECTS(pRegion);
+	nbox = REGION_NUM_RECTS(pRegion);
+
+	GLAMOMonoCacheNewBatch(pGlamo);
+
+	if (pGC->fillStyle == FillStippled) {
+		GLAMOExaSetupBlt(pGlamo, cache->offset, cache->pitch, pPix,
+				GLAMOBltRop[GXcopy]);
+		if (fg != 0xffff) {
+			cell = GLAMOGCGetCell(pGlamo, rows, pw, ph, 0xffff, 0);
+			GLAMOGCSetRop(pGlamo, GLAMOBltRop[GXandInverted]);
+			for (i = 0; i < nbox; i++)
+				GLAMOTileBox(pGlamo, cell->x, cell->y, pw, ph,
+					     &pbox[i],
+					     GLAMOMod(pbox[i].x1 - orgx, pw),
+					     GLAMOMod(pbox[i].y1 - orgy, ph),
+					     xoff, yoff);
+		}
+		if (fg != 0) {
+			cell = GLAMOGCGetCell(pGlamo, rows, pw, ph, fg, 0);
+			GLAMOGCSetRop(pGlamo, GLAMOBltRop[GXor]);
+			for (i = 0; i < nbox; i++)
+				GLAMOTileBox(pGlamo, cell->x, cell->y, pw, ph,
+					     &pbox[i],
+					     GLAMOMod(pbox[i].x1 - orgx, pw),
+					     GLAMOMod(pbox[i].y1 - orgy, ph),
+					     xoff, yoff);
+		}
+	} else {
+		if (pGC->fillStyle == FillTiled) {
+			src_offset = GLAMOPixmapOffset(pTile);
+			src_pitch = pTile->devKind;
+			sx = 0;
+			sy = 0;
+			pw = pTile->drawable.width;
+			ph = pTile->drawable.height;
+		} else {
+			cell = GLAMOGCGetCell(pGlamo, rows, pw, ph, fg, bg);
+			src_offset = cache->offset;
+			src_pitch = cache->pitch;
+			sx = cell->x;
+			sy = cell->y;
+		}
+
+		GLAMOTileBoxes(pGlamo, src_offset, src_pitch, sx, sy, pw, ph,
+			       pPix, pbox, nbox, orgx, orgy, xoff, yoff);
+		if (pGC->fillStyle == FillTiled)
+			GLAMOPixmapFence(pGlamo, pTile);
+	}
+
+	extents = REGION_EXTENTS(pDrawable->pScreen, pRegion);
+	if (REGION_NOTEMPTY(pDrawable->pScreen, pRegion))
+		GLAMOPixmapDirty(pGlamo, pPix, extents->x1 + xoff,
+				 extents->y1 + yoff, extents->x2 + xoff,
+				 extents->y2 + yoff);
+	GLAMOPixmapFence(pGlamo, pPix);
+	GLAMOFlushCMDQCache(pGlamo, 1);
+	exaMarkSync(pDrawable->pScreen);
+
+	DamageDamageRegion(pDrawable, pRegion);
+	if (pDrawable != &pPix->drawable) {
+		REGION_TRANSLATE(pDrawable->pScreen, pRegion, xoff, yoff);
+		DamageDamageRegion(&pPix->drawable, pRegion);
+		REGION_TRANSLATE(pDrawable->pScreen, pRegion, -xoff, -yoff);
+	}
+
+	pixels = 0;
+	for (i = 0; i < nbox; i++)
+		pixels += (pbox[i].x2 - pbox[i].x1) * (pbox[i].y2 - pbox[i].y1);
+	GLAMOStatEnd(pGlamo, GLAMO_STAT_PATTERN_FILL, pixels, 0);
+
+	return TRUE;
+}
+
+static Bool
+GLAMOPolyFillRectPattern(DrawablePtr pDrawable, GCPtr pGC, int nrect,
+			 xRectangle *prect)
+{
+	ScreenPtr pScreen = pDrawable->pScreen;
+	RegionPtr pRegion;
+	Bool ret;
+
+	if (pGC->fillStyle == FillSolid ||
+	    (pGC->fillStyle == FillTiled && pGC->tileIsPixel))
+		return FALSE;
+
+	pRegion = RECTS_TO_REGION(pScreen, nrect, prect, CT_UNSORTED);
+	REGION_TRANSLATE(pScreen, pRegion, pDrawable->x, pDrawable->y);
+	REGION_INTERSECT(pScreen, pRegion, pRegion, pGC->pCompositeClip);
+
+	ret = GLAMOFillRegionPattern(pDrawable, pGC, pRegion);
+
+	REGION_DESTROY(pScreen, pRegion);
+
+	return ret;
+}
+
+/* GC funcs */
+
+static void
+GLAMOValidateGC(GCPtr pGC, unsigned long changes, DrawablePtr pDrawable)
+{
+	GLAMO_GC_FUNC_PROLOGUE(pGC);
+	(*pGC->funcs->ValidateGC)(pGC, changes, pDrawable);
+	pGCPriv->ops = pGC->ops; /* make the epilogue wrap the ops */
+	GLAMO_GC_FUNC_EPILOGUE(pGC);
+}
+
+static void
+GLAMOChangeGC(GCPtr pGC, unsigned long mask)
+{
+	GLAMO_GC_FUNC_PROLOGUE(pGC);
+	(*pGC->funcs->ChangeGC)(pGC, mask);
+	GLAMO_GC_FUNC_EPILOGUE(pGC);
+}
+
+static void
+GLAMOCopyGC(GCPtr pGCSrc, unsigned long mask, GCPtr pGCDst)
+{
+	GLAMO_GC_FUNC_PROLOGUE(pGCDst);
+	(*pGCDst->funcs->CopyGC)(pGCSrc, mask, pGCDst);
+	GLAMO_GC_FUNC_EPILOGUE(pGCDst);
+}
+
+static void
+GLAMODestroyGC(GCPtr pGC)
+{
+	GLAMO_GC_FUNC_PROLOGUE(pGC);
+	(*pGC->funcs->DestroyGC)(pGC);
+	GLAMO_GC_FUNC_EPILOGUE(pGC);
+}
+
+static void
+GLAMOChangeClip(GCPtr pGC, int type, pointer pvalue, int nrects)
+{
+	GLAMO_GC_FUNC_PROLOGUE(pGC);
+	(*pGC->funcs->ChangeClip)(pGC, type, pvalue, nrects);
+	GLAMO_GC_FUNC_EPILOGUE(pGC);
+}
+
+static void
+GLAMODestroyClip(GCPtr pGC)
+{
+	GLAMO_GC_FUNC_PROLOGUE(pGC);
+	(*pGC->funcs->DestroyClip)(pGC);
+	GLAMO_GC_FUNC_EPILOGUE(pGC);
+}
+
+static void
+GLAMOCopyClip(GCPtr pGCDst, GCPtr pGCSrc)
+{
+	GLAMO_GC_FUNC_PROLOGUE(pGCDst);
+	(*pGCDst->funcs->CopyClip)(pGCDst, pGCSrc);
+	GLAMO_GC_FUNC_EPILOGUE(pGCDst);
+}
+
+static GCFuncs GLAMOGCFuncs = {
+	GLAMOValidateGC,
+	GLAMOChangeGC,
+	GLAMOCopyGC,
+	GLAMODestroyGC,
+	GLAMOChangeClip,
+	GLAMODestroyClip,
+	GLAMOCopyClip,
+};
+
+/* GC ops */
+
+static void
+GLAMOFillSpans(DrawablePtr pDrawable, GCPtr pGC, int nInit,
+	       DDXPointPtr pptInit, int *pwidthInit, int fSorted)
+{
+	GLAMO_GC_OP_PROLOGUE(pGC);
+	(*pGC->ops->FillSpans)(pDrawable, pGC, nInit, pptInit, pwidthInit,
+			       fSorted);
+	GLAMO_GC_OP_EPILOGUE(pGC);
+}
+
+static void
+GLAMOSetSpans(DrawablePtr pDrawable, GCPtr pGC, char *psrc,
+	      DDXPointPtr ppt, int *pwidth, int nspans, int fSorted)
+{
+	GLAMO_GC_OP_PROLOGUE(pGC);
+	(*pGC->ops->SetSpans)(pDrawable, pGC, psrc, ppt, pwidth, nspans,
+			      fSorted);
+	GLAMO_GC_OP_EPILOGUE(pGC);
+}
+
+static void
+GLAMOPutImage(DrawablePtr pDrawable, GCPtr pGC, int depth, int x, int y,
+	      int w, int h, int leftPad, int format, char *pBits)
+{
+	GLAMO_GC_OP_PROLOGUE(pGC);
+	if (format != XYBitmap ||
+	    !GLAMOPutBitmap(pDrawable, pGC, x, y, w, h, leftPad, pBits))
+		(*pGC->ops->PutImage)(pDrawable, pGC, depth, x, y, w, h,
+				      leftPad, format, pBits);
+	GLAMO_GC_OP_EPILOGUE(pGC);
+}
+
+static RegionPtr
+GLAMOCopyArea(DrawablePtr pSrc, DrawablePtr pDst, GCPtr pGC, int srcx,
+	      int srcy, int width, int height, int dstx, int dsty)
+{
+	RegionPtr ret;
+
+	GLAMO_GC_OP_PROLOGUE(pGC);
+	ret = (*pGC->ops->CopyArea)(pSrc, pDst, pGC, srcx, srcy, width, height,
+				    dstx, dsty);
+	GLAMO_GC_OP_EPILOGUE(pGC);
+
+	return ret;
+}
+
+static RegionPtr
+GLAMOCopyPlane(DrawablePtr pSrc, DrawablePtr pDst, GCPtr pGC, int srcx,
+	       int srcy, int width, int height, int dstx, int dsty,
+	       unsigned long bitPlane)
+{
+	RegionPtr ret;
+
+	GLAMO_GC_OP_PROLOGUE(pGC);
+	ret = (*pGC->ops->CopyPlane)(pSrc, pDst, pGC, srcx, srcy, width,
+				     height, dstx, dsty, bitPlane);
+	GLAMO_GC_OP_EPILOGUE(pGC);
+
+	return ret;
+}
+
+static void
+GLAMOPolyPoint(DrawablePtr pDrawable, GCPtr pGC, int mode, int npt,
+	       DDXPointPtr ppt)
+{
+	GLAMO_GC_OP_PROLOGUE(pGC);
+	(*pGC->ops->PolyPoint)(pDrawable, pGC, mode, npt, ppt);
+	GLAMO_GC_OP_EPILOGUE(pGC);
+}
+
+static void
+GLAMOPolylines(DrawablePtr pDrawable, GCPtr pGC, int mode, int npt,
+	       DDXPointPtr ppt)
+{
+	GLAMO_GC_OP_PROLOGUE(pGC);
+	(*pGC->ops->Polylines)(pDrawable, pGC, mode, npt, ppt);
+	GLAMO_GC_OP_EPILOGUE(pGC);
+}
+
+static void
+GLAMOPolySegment(DrawablePtr pDrawable, GCPtr pGC, int nSeg, xSegment *pSeg)
+{
+	GLAMO_GC_OP_PROLOGUE(pGC);
+	(*pGC->ops->PolySegment)(pDrawable, pGC, nSeg, pSeg);
+	GLAMO_GC_OP_EPILOGUE(pGC);
+}
+
+static void
+GLAMOPolyRectangle(DrawablePtr pDrawable, GCPtr pGC, int nRects,
+		   xRectangle *pRects)
+{
+	GLAMO_GC_OP_PROLOGUE(pGC);
+	(*pGC->ops->PolyRectangle)(pDrawable, pGC, nRects, pRects);
+	GLAMO_GC_OP_EPILOGUE(pGC);
+}
+
+static void
+GLAMOPolyArc(DrawablePtr pDrawable, GCPtr pGC, int nArcs, xArc *pArcs)
+{
+	GLAMO_GC_OP_PROLOGUE(pGC);
+	(*pGC->ops->PolyArc)(pDrawable, pGC, nArcs, pArcs);
+	GLAMO_GC_OP_EPILOGUE(pGC);
+}
+
+static void
+GLAMOFillPolygon(DrawablePtr pDrawable, GCPtr pGC, int shape, int mode,
+		 int npt, DDXPointPtr ppt)
+{
+	GLAMO_GC_OP_PROLOGUE(pGC);
+	(*pGC->ops->FillPolygon)(pDrawable, pGC, shape, mode, npt, ppt);
+	GLAMO_GC_OP_EPILOGUE(pGC);
+}
+
+static void
+GLAMOPolyFillRect(DrawablePtr pDrawable, GCPtr pGC, int nRects,
+		  xRectangle *pRects)
+{
+	GLAMO_GC_OP_PROLOGUE(pGC);
+	if (!GLAMOPolyFillRectPattern(pDrawable, pGC, nRects, pRects))
+		(*pGC->ops->PolyFillRect)(pDrawable, pGC, nRects, pRects);
+	GLAMO_GC_OP_EPILOGUE(pGC);
+}
+
+static void
+GLAMOPolyFillArc(DrawablePtr pDrawable, GCPtr pGC, int nArcs, xArc *pArcs)
+{
+	GLAMO_GC_OP_PROLOGUE(pGC);
+	(*pGC->ops->PolyFillArc)(pDrawable, pGC, nArcs, pArcs);
+	GLAMO_GC_OP_EPILOGUE(pGC);
+}
+
+static FontEncoding
+GLAMOFontEncoding16(FontPtr pFont)
+{
+	return FONTLASTROW(pFont) == 0 ? Linear16Bit : TwoD16Bit;
+}
+
+static int
+GLAMOPolyText(DrawablePtr pDrawable, GCPtr pGC, int x, int y, int count,
+	      unsigned char *chars, FontEncoding encoding)
+{
+	CharInfoPtr charinfo[255];
+	unsigned long n, i;
+	int width = 0;
+
+	if (count > 255)
+		return -1;
+
+	GetGlyphs(pGC->font, count, chars, encoding, &n, charinfo);
+	if (!GLAMOGlyphBlt(pDrawable, pGC, x, y, n, charinfo, FALSE))
+		return -1;
+
+	for (i = 0; i < n; i++)
+		width += charinfo[i]->metrics.characterWidth;
+
+	return x + width;
+}
+
+static Bool
+GLAMOImageText(DrawablePtr pDrawable, GCPtr pGC, int x, int y, int count,
+	       unsigned char *chars, FontEncoding encoding)
+{
+	CharInfoPtr charinfo[255];
+	unsigned long n;
+
+	if (count > 255)
+		return FALSE;
+
+	GetGlyphs(pGC->font, count, chars, encoding, &n, charinfo);
+	if (!n)
+		return TRUE;
+
+	return GLAMOGlyphBlt(pDrawable, pGC, x, y, n, charinfo, TRUE);
+}
+
+static int
+GLAMOPolyText8(DrawablePtr pDrawable, GCPtr pGC, int x, int y, int count,
+	       char *chars)
+{
+	int ret;
+
+	GLAMO_GC_OP_PROLOGUE(pGC);
+	ret = GLAMOPolyText(pDrawable, pGC, x, y, count,
+			    (unsigned char *) chars, Linear8Bit);
+	if (ret < 0)
+		ret = (*pGC->ops->PolyText8)(pDrawable, pGC, x, y, count,
+					     chars);
+	GLAMO_GC_OP_EPILOGUE(pGC);
+
+	return ret;
+}
+
+static int
+GLAMOPolyText16(DrawablePtr pDrawable, GCPtr pGC, int x, int y, int count,
+		unsigned short *chars)
+{
+	int ret;
+
+	GLAMO_GC_OP_PROLOGUE(pGC);
+	ret = GLAMOPolyText(pDrawable, pGC, x, y, count,
+			    (unsigned char *) chars,
+			    GLAMOFontEncoding16(pGC->font));
+	if (ret < 0)
+		ret = (*pGC->ops->PolyText16)(pDrawable, pGC, x, y, count,
+					      chars);
+	GLAMO_GC_OP_EPILOGUE(pGC);
+
+	return ret;
+}
+
+static void
+GLAMOImageText8(DrawablePtr pDrawable, GCPtr pGC, int x, int y, int count,
+		char *chars)
+{
+	GLAMO_GC_OP_PROLOGUE(pGC);
+	if (!GLAMOImageText(pDrawable, pGC, x, y, count,
+			    (unsigned char *) chars, Linear8Bit))
+		(*pGC->ops->ImageText8)(pDrawable, pGC, x, y, count, chars);
+	GLAMO_GC_OP_EPILOGUE(pGC);
+}
+
+static void
+GLAMOImageText16(DrawablePtr pDrawable, GCPtr pGC, int x, int y, int count,
+		 unsigned short *chars)
+{
+	GLAMO_GC_OP_PROLOGUE(pGC);
+	if (!GLAMOImageText(pDrawable, pGC, x, y, count,
+			    (unsigned char *) chars,
+			    GLAMOFontEncoding16(pGC->font)))
+		(*pGC->ops->ImageText16)(pDrawable, pGC, x, y, count, chars);
+	GLAMO_GC_OP_EPILOGUE(pGC);
+}
+
+static void
+GLAMOImageGlyphBlt(DrawablePtr pDrawable, GCPtr pGC, int x, int y,
+		   unsigned int nglyph, CharInfoPtr *ppci, pointer pglyphBase)
+{
+	GLAMO_GC_OP_PROLOGUE(pGC);
+	if (!GLAMOGlyphBlt(pDrawable, pGC, x, y, nglyph, ppci, TRUE))
+		(*pGC->ops->ImageGlyphBlt)(pDrawable, pGC, x, y, nglyph, ppci,
+					   pglyphBase);
+	GLAMO_GC_OP_EPILOGUE(pGC);
+}
+
+static void
+GLAMOPolyGlyphBlt(DrawablePtr pDrawable, GCPtr pGC, int x, int y,
+		  unsigned int nglyph, CharInfoPtr *ppci, pointer pglyphBase)
+{
+	GLAMO_GC_OP_PROLOGUE(pGC);
+	if (!GLAMOGlyphBlt(pDrawable, pGC, x, y, nglyph, ppci, FALSE))
+		(*pGC->ops->PolyGlyphBlt)(pDrawable, pGC, x, y, nglyph, ppci,
+					  pglyphBase);
+	GLAMO_GC_OP_EPILOGUE(pGC);
+}
+
+static void
+GLAMOPushPixels(GCPtr pGC, PixmapPtr pBitMap, DrawablePtr pDrawable,
+		int dx, int dy, int xOrg, int yOrg)
+{
+	GLAMO_GC_OP_PROLOGUE(pGC);
+	(*pGC->ops->PushPixels)(pGC, pBitMap, pDrawable, dx, dy, xOrg, yOrg);
+	GLAMO_GC_OP_EPILOGUE(pGC);
+}
+
+static GCOps GLAMOGCOps = {
+	GLAMOFillSpans,
+	GLAMOSetSpans,
+	GLAMOPutImage,
+	GLAMOCopyArea,
+	GLAMOCopyPlane,
+	GLAMOPolyPoint,
+	GLAMOPolylines,
+	GLAMOPolySegment,
+	GLAMOPolyRectangle,
+	GLAMOPolyArc,
+	GLAMOFillPolygon,
+	GLAMOPolyFillRect,
+	GLAMOPolyFillArc,
+	GLAMOPolyText8,
+	GLAMOPolyText16,
+	GLAMOImageText8,
+	GLAMOImageText16,
+	GLAMOImageGlyphBlt,
+	GLAMOPolyGlyphBlt,
+	GLAMOPushPixels,
+};
+
+static Bool
+GLAMOCreateGC(GCPtr pGC)
+{
+	ScreenPtr pScreen = pGC->pScreen;
+	GlamoPtr pGlamo = GlamoPTR(xf86Screens[pScreen->myNum]);
+	GlamoGCPrivPtr pGCPriv = GLAMOGetGCPriv(pGC);
+	Bool ret;
+
+	pScreen->CreateGC = pGlamo->CreateGC;
+	ret = (*pScreen->CreateGC)(pGC);
+	pGlamo->CreateGC = pScreen->CreateGC;
+	pScreen->CreateGC = GLAMOCreateGC;
+
+	if (ret) {
+		pGCPriv->ops = NULL;
+		pGCPriv->funcs = pGC->funcs;
+		pGC->funcs = &GLAMOGCFuncs;
+	}
+
+	return ret;
+}
+
+Bool
+GLAMOGCInit(ScreenPtr pScreen)
+{
+	GlamoPtr pGlamo = GlamoPTR(xf86Screens[pScreen->myNum]);
+
+	if (!dixRequestPrivate(GLAMOGCPrivateKey, sizeof(GlamoGCPrivRec)))
+		return FALSE;
+
+	pGlamo->CreateGC = pScreen->CreateGC;
+	pScreen->CreateGC = GLAMOCreateGC;
+
+	return TRUE;
+}
+
+void
+GLAMOGCFini(ScreenPtr pScreen)
+{
+	GlamoPtr pGlamo = GlamoPTR(xf86Screens[pScreen->myNum]);
+
+	if (!pGlamo->CreateGC)
+		return;
+
+	pScreen->CreateGC = pGlamo->CreateGC;
+	pGlamo->CreateGC = NULL;
+}
@@ -45,6 +45,11 @@ static const char *display_state_qvga = "qvga-normal";
 static void
 GlamoOutputDPMS(xf86OutputPtr output, int mode) {}
 
+static void
+GlamoOutputCreateResources(xf86OutputPtr output) {
+    GLAMOStatsOutputInit(output);
+}
+
 static xf86OutputStatus
 GlamoOutputDetect(xf86OutputPtr output);
 
@@ -82,7 +87,7 @@ static DisplayModePtr
 GlamoOutputGetModes(xf86OutputPtr output);
 
 static const xf86OutputFuncsRec glamo_output_funcs = {
-    .create_resources = NULL,
+    .create_resources = GlamoOutputCreateResources,
     .dpms = GlamoOutputDPMS,
     .save = NULL,
     .restore = NULL,
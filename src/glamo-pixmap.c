@@ -0,0 +1,767 @@
+/*
+ * Copyright  2007 OpenMoko, Inc.
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation, and
+ * that the name of the copyright holders not be used in advertising or
+ * publicity pertaining to distribution of the software without specific,
+ * written prior permission.  The copyright holders make no representations
+ * about the suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO
+ * EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE,
+ * DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER
+ * TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+ * OF THIS SOFTWARE.
+ */
+
+/*
+ * Driver allocated pixmaps.  Small pixmaps, which toolkits create and
+ * destroy all the time, come from slabs of VRAM split into objects of a
+ * few fixed sizes, so allocating and freeing them is a free list
+ * operation and they don't fragment the offscreen heap.  Larger pixmaps
+ * get an offscreen area of their own, which is moved down the heap when
+ * the server is idle, and pixmaps that don't fit in VRAM at all live in
+ * system memory and are drawn by fb until there is room for them.
+ *
+ * The CPU reads VRAM much slower than it writes it, so with the
+ * ReadbackCache option, small pixmaps the CPU keeps going back to get a
+ * copy in system memory that fallbacks and downloads read instead.  Blits,
+ * uploads and the CPU paths of the 2D code mark what they change, and only
+ * the bounds of that are read back before the copy is used again.  A
+ * fallback drawing to the pixmap draws to the copy, which is then written
+ * back whole, hence the size limit.
+ *
+ * Pixmaps cleared as a whole are remembered to be of that colour until
+ * anything else draws to them, so that clearing them again, copying from
+ * them and reading them back don't need the blitter or VRAM.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+#include <string.h>
+#include "glamo.h"
+#include "glamo-cmdq.h"
+#include "glamo-draw.h"
+
+/* Largest pixmap getting a readback cache, and the accesses it takes. */
+#define GLAMO_READBACK_MAX_SIZE	(64 * 1024)
+#define GLAMO_READBACK_HOT	4
+
+static const int GLAMOPixmapPoolSizes[GLAMO_PIXMAP_POOLS] = {
+	1024,
+	4096,
+	16384,
+};
+
+static GlamoPixmapPoolPtr
+GLAMOPixmapGetPool(GlamoPtr pGlamo, int size)
+{
+	int i;
+
+	for (i = 0; i < GLAMO_PIXMAP_POOLS; i++) {
+		if (size <= pGlamo->pixmap_pools[i].size)
+			return &pGlamo->pixmap_pools[i];
+	}
+
+	return NULL;
+}
+
+static void
+GLAMOSlabUnlink(GlamoSlabPtr *list, GlamoSlabPtr slab)
+{
+	if (slab->prev)
+		slab->prev->next = slab->next;
+	else
+		*list = slab->next;
+	if (slab->next)
+		slab->next->prev = slab->prev;
+	slab->prev = slab->next = NULL;
+}
+
+static void
+GLAMOSlabPush(GlamoSlabPtr *list, GlamoSlabPtr slab)
+{
+	slab->prev = NULL;
+	slab->next = *list;
+	if (*list)
+		(*list)->prev = slab;
+	*list = slab;
+}
+
+static GlamoSlabPtr
+GLAMOSlabCreate(GlamoPtr pGlamo, GlamoPixmapPoolPtr pool)
+{
+	GlamoSlabPtr slab;
+	int i, n = GLAMO_SLAB_SIZE / pool->size;
+
+	slab = xcalloc(1, sizeof(GlamoSlabRec));
+	if (!slab)
+		return NULL;
+
+	slab->area = GLAMOVRAMAlloc(pGlamo, GLAMO_VRAM_PIXMAPS,
+				    GLAMO_SLAB_SIZE);
+	if (!slab->area) {
+		xfree(slab);
+		return NULL;
+	}
+
+	for (i = 0; i < n; i++)
+		slab->link[i] = i + 1;
+	slab->link[n - 1] = -1;
+	slab->free = 0;
+	slab->nfree = n;
+
+	GLAMOSlabPush(&pool->partial, slab);
+	pool->nslabs++;
+
+	return slab;
+}
+
+static void
+GLAMOSlabDestroy(GlamoPtr pGlamo, GlamoPixmapPoolPtr pool, GlamoSlabPtr slab)
+{
+	GLAMOSlabUnlink(slab->nfree ? &pool->partial : &pool->full, slab);
+	pool->nslabs--;
+
+	GLAMOVRAMFree(pGlamo, GLAMO_VRAM_PIXMAPS, slab->area);
+	xfree(slab);
+}
+
+/* Slabs with free objects are on the partial list, full ones are not. */
+static Bool
+GLAMOSlabAlloc(GlamoPtr pGlamo, GlamoPixmapPoolPtr pool,
+	       GlamoPixmapPrivPtr priv)
+{
+	GlamoSlabPtr slab = pool->partial;
+
+	if (!slab) {
+		slab = GLAMOSlabCreate(pGlamo, pool);
+		if (!slab)
+			return FALSE;
+	}
+
+	priv->slab = slab;
+	priv->index = slab->free;
+	priv->offset = slab->area->offset + priv->index * pool->size;
+
+	slab->free = slab->link[priv->index];
+	slab->nfree--;
+	pool->allocs++;
+
+	if (!slab->nfree) {
+		GLAMOSlabUnlink(&pool->partial, slab);
+		GLAMOSlabPush(&pool->full, slab);
+	}
+
+	return TRUE;
+}
+
+static void
+GLAMOSlabFree(GlamoPtr pGlamo, GlamoPixmapPoolPtr pool,
+	      GlamoPixmapPrivPtr priv)
+{
+	GlamoSlabPtr slab = priv->slab;
+
+	if (!slab->nfree) {
+		GLAMOSlabUnlink(&pool->full, slab);
+		GLAMOSlabPush(&pool->partial, slab);
+	}
+
+	slab->link[priv->index] = slab->free;
+	slab->free = priv->index;
+	slab->nfree++;
+
+	/* Keep one slab around, give the others back once they're empty. */
+	if (slab->nfree == GLAMO_SLAB_SIZE / pool->size && pool->nslabs > 1)
+		GLAMOSlabDestroy(pGlamo, pool, slab);
+}
+
+/*
+ * Put a pixmap in a slab or in an area of its own.  Objects in a slab are
+ * only as aligned as the slab itself.
+ */
+static Bool
+GLAMOPixmapAllocVRAM(GlamoPtr pGlamo, GlamoPixmapPrivPtr priv)
+{
+	GlamoPixmapPoolPtr pool = GLAMOPixmapGetPool(pGlamo, priv->size);
+
+	if (pool && priv->align <= pGlamo->exa->pixmapOffsetAlign &&
+	    GLAMOSlabAlloc(pGlamo, pool, priv)) {
+		priv->in_vram = TRUE;
+		return TRUE;
+	}
+
+	priv->area = GLAMOVRAMAllocAligned(pGlamo, GLAMO_VRAM_PIXMAPS,
+					   priv->size, priv->align);
+	if (!priv->area)
+		return FALSE;
+
+	/* Found by GLAMOPixmapCompact */
+	priv->area->privData = priv;
+	priv->offset = priv->area->offset;
+	priv->in_vram = TRUE;
+	return TRUE;
+}
+
+void *
+GLAMOExaCreatePixmap(ScreenPtr pScreen, int size, int align)
+{
+	ScrnInfoPtr pScrn = xf86Screens[pScreen->myNum];
+	GlamoPtr pGlamo = GlamoPTR(pScrn);
+	GlamoPixmapPrivPtr priv;
+
+	priv = xcalloc(1, sizeof(GlamoPixmapPrivRec));
+	if (!priv || !size)
+		return priv;
+
+	priv->size = size;
+	priv->align = max(align, pGlamo->exa->pixmapOffsetAlign);
+
+	if (GLAMOPixmapAllocVRAM(pGlamo, priv))
+		return priv;
+
+	priv->sys = xalloc(size);
+	if (!priv->sys) {
+		xfree(priv);
+		return NULL;
+	}
+	priv->sys_next = pGlamo->pixmap_sys;
+	pGlamo->pixmap_sys = priv;
+	pGlamo->pixmap_sys_allocs++;
+
+	return priv;
+}
+
+void
+GLAMOExaDestroyPixmap(ScreenPtr pScreen, void *driverPriv)
+{
+	ScrnInfoPtr pScrn = xf86Screens[pScreen->myNum];
+	GlamoPtr pGlamo = GlamoPTR(pScrn);
+	GlamoPixmapPrivPtr priv = driverPriv, *prev;
+
+	if (!priv)
+		return;
+
+	/* The blitter may still be drawing into the memory we give back. */
+	if (priv->in_vram)
+		GLAMOFenceWait(pGlamo, priv->fence);
+
+	if (priv->cache) {
+		pGlamo->readback_used -= priv->size;
+		xfree(priv->cache);
+	}
+
+	if (priv->slab)
+		GLAMOSlabFree(pGlamo, GLAMOPixmapGetPool(pGlamo, priv->size),
+			      priv);
+	else if (priv->area)
+		GLAMOVRAMFree(pGlamo, GLAMO_VRAM_PIXMAPS, priv->area);
+	else if (priv->sys && priv->size) {
+		for (prev = &pGlamo->pixmap_sys; *prev != priv;
+		     prev = &(*prev)->sys_next)
+			;
+		*prev = priv->sys_next;
+		xfree(priv->sys);
+	}
+
+	xfree(priv);
+}
+
+/*
+ * Pixmaps wrapped around existing memory, like the screen pixmap, carry
+ * no allocation of ours; just note where they are.  EXA never prepares
+ * access to pixmaps of ours in system memory, so fb gets their memory
+ * here, when EXA sets up the header of a pixmap it just created.
+ */
+Bool
+GLAMOExaModifyPixmapHeader(PixmapPtr pPixmap, int width, int height,
+			   int depth, int bitsPerPixel, int devKind,
+			   pointer pPixData)
+{
+	ScrnInfoPtr pScrn = xf86Screens[pPixmap->drawable.pScreen->myNum];
+	GlamoPtr pGlamo = GlamoPTR(pScrn);
+	GlamoPixmapPrivPtr priv = exaGetPixmapDriverPrivate(pPixmap);
+	CARD8 *data = pPixData;
+
+	if (priv && priv->size) {
+		priv->pixmap = pPixmap;
+		if (priv->sys) {
+			pPixmap->devPrivate.ptr = priv->sys;
+			if (devKind > 0)
+				pPixmap->devKind = devKind;
+		}
+		return FALSE;
+	}
+
+	if (!priv || !data)
+		return FALSE;
+
+	if (data >= pGlamo->exa->memoryBase &&
+	    data < pGlamo->exa->memoryBase + pGlamo->exa->memorySize) {
+		priv->offset = data - pGlamo->exa->memoryBase;
+		priv->in_vram = TRUE;
+	} else {
+		priv->sys = data;
+		priv->in_vram = FALSE;
+		/* A shadowed screen is blitted to at the scanout, at the start. */
+		priv->offset = 0;
+	}
+
+	return FALSE;
+}
+
+Bool
+GLAMOExaPrepareAccess(PixmapPtr pPix, int index)
+{
+	ScrnInfoPtr pScrn = xf86Screens[pPix->drawable.pScreen->myNum];
+	GlamoPtr pGlamo = GlamoPTR(pScrn);
+	GlamoPixmapPrivPtr priv = exaGetPixmapDriverPrivate(pPix);
+
+	if (!priv)
+		return FALSE;
+
+#ifdef EXA_PREPARE_AUX_DEST
+	if (index == EXA_PREPARE_DEST || index == EXA_PREPARE_AUX_DEST)
+#else
+	if (index == EXA_PREPARE_DEST)
+#endif
+		priv->solid = FALSE;
+
+	if (priv->in_vram && GLAMOPixmapCache(pGlamo, pPix)) {
+		pPix->devPrivate.ptr = priv->cache;
+		return TRUE;
+	}
+
+	GLAMOPixmapWait(pGlamo, pPix);
+
+	if (GLAMOShadowIsScreen(pGlamo, pPix))
+		GLAMOShadowSync(pGlamo, pPix);
+
+	if (priv->in_vram)
+		pPix->devPrivate.ptr = pGlamo->exa->memoryBase + priv->offset;
+	else
+		pPix->devPrivate.ptr = priv->sys;
+
+	return TRUE;
+}
+
+/* Write back what a fallback drew to the readback cache. */
+void
+GLAMOExaFinishAccess(PixmapPtr pPix, int index)
+{
+	ScrnInfoPtr pScrn = xf86Screens[pPix->drawable.pScreen->myNum];
+	GlamoPtr pGlamo = GlamoPTR(pScrn);
+	GlamoPixmapPrivPtr priv = exaGetPixmapDriverPrivate(pPix);
+	int size;
+
+	if (!priv || !priv->cache)
+		return;
+#ifdef EXA_PREPARE_AUX_DEST
+	if (index != EXA_PREPARE_DEST && index != EXA_PREPARE_AUX_DEST)
+#else
+	if (index != EXA_PREPARE_DEST)
+#endif
+		return;
+
+	/* The blitter may still be reading the old contents. */
+	GLAMOPixmapWait(pGlamo, pPix);
+
+	size = pPix->devKind * pPix->drawable.height;
+	GLAMOTransferRect(pGlamo->upload_row,
+			  pGlamo->exa->memoryBase + priv->offset, size,
+			  priv->cache, size, size, 1);
+	pGlamo->readback_written += size;
+}
+
+/*
+ * The shadowed screen counts as offscreen, so that EXA offers it to the
+ * copy hook, which blits copies from VRAM to the scanout, and prepares
+ * access to it before software draws to it.  The other hooks leave it to
+ * software, and the driver's own paths only see pixmaps in VRAM.
+ */
+Bool
+GLAMOExaPixmapIsOffscreen(PixmapPtr pPix)
+{
+	ScrnInfoPtr pScrn = xf86Screens[pPix->drawable.pScreen->myNum];
+	GlamoPixmapPrivPtr priv = exaGetPixmapDriverPrivate(pPix);
+
+	return priv && (priv->in_vram ||
+			GLAMOShadowIsScreen(GlamoPTR(pScrn), pPix));
+}
+
+void
+GLAMOPixmapInit(GlamoPtr pGlamo)
+{
+	int i;
+
+	for (i = 0; i < GLAMO_PIXMAP_POOLS; i++)
+		pGlamo->pixmap_pools[i].size = GLAMOPixmapPoolSizes[i];
+}
+
+void
+GLAMOPixmapFini(GlamoPtr pGlamo)
+{
+	GlamoPixmapPoolPtr pool;
+	int i;
+
+	for (i = 0; i < GLAMO_PIXMAP_POOLS; i++) {
+		pool = &pGlamo->pixmap_pools[i];
+		xf86DrvMsg(pGlamo->pScreen->myNum, X_INFO,
+			   "Pixmap pool of %d bytes: %lu allocations, "
+			   "%d slabs left\n", pool->size, pool->allocs,
+			   pool->nslabs);
+		/* Slabs still in use go away with the offscreen heap. */
+		while (pool->partial && pool->partial->nfree ==
+		       GLAMO_SLAB_SIZE / pool->size)
+			GLAMOSlabDestroy(pGlamo, pool, pool->partial);
+	}
+	xf86DrvMsg(pGlamo->pScreen->myNum, X_INFO,
+		   "Pixmaps put in system memory: %lu, moved to VRAM later: "
+		   "%lu\n", pGlamo->pixmap_sys_allocs,
+		   pGlamo->pixmap_migrations);
+	xf86DrvMsg(pGlamo->pScreen->myNum, X_INFO,
+		   "CPU accesses waiting for the blitter: %lu, not waiting: "
+		   "%lu\n", pGlamo->fence_waits, pGlamo->fence_skips);
+	if (pGlamo->readback_budget)
+		xf86DrvMsg(pGlamo->pScreen->myNum, X_INFO,
+			   "Readback cache: %lu accesses served, %lukB read "
+			   "back, %lukB written back, %lukB in use\n",
+			   pGlamo->readback_hits,
+			   pGlamo->readback_refreshed / 1024,
+			   pGlamo->readback_written / 1024,
+			   pGlamo->readback_used / 1024);
+}
+
+/*
+ * Move pixmaps put in system memory when VRAM was full into VRAM once
+ * there is room for them again.  Called when the server is idle, so fb
+ * can't be drawing to them.  Writing VRAM is fast for the CPU, so this
+ * costs about as much as uploading them.
+ */
+void
+GLAMOPixmapMigrate(GlamoPtr pGlamo)
+{
+	GlamoPixmapPrivPtr priv, *prev = &pGlamo->pixmap_sys;
+
+	while ((priv = *prev)) {
+		if (!priv->pixmap || !GLAMOPixmapAllocVRAM(pGlamo, priv)) {
+			prev = &priv->sys_next;
+			continue;
+		}
+		*prev = priv->sys_next;
+		priv->sys_next = NULL;
+
+		GLAMOTransferRect(pGlamo->upload_row,
+				  pGlamo->exa->memoryBase + priv->offset,
+				  priv->size, priv->sys, priv->size,
+				  priv->size, 1);
+		xfree(priv->sys);
+		priv->sys = NULL;
+		/* Set by GLAMOExaPrepareAccess from now on */
+		priv->pixmap->devPrivate.ptr = NULL;
+		pGlamo->pixmap_migrations++;
+	}
+}
+
+/* Pixmaps moved by one pass of GLAMOPixmapCompact, at most */
+#define GLAMO_COMPACT_MOVES	8
+
+/*
+ * The areas of our pixmaps are locked, since only the driver knows which
+ * pixmap owns one, so EXA's own compaction passes over them.  Once the
+ * server is idle, pixmaps with an area of their own are moved down into
+ * the first free block below them that is large enough, which merges the
+ * area they leave with the free space around it.  Slabs stay where they
+ * are: their objects are small and come in a few sizes, so their holes
+ * get reused rather than left.
+ */
+void
+GLAMOPixmapCompact(GlamoPtr pGlamo)
+{
+	ExaOffscreenArea *area, *dst;
+	GlamoPixmapPrivPtr priv;
+	int moves, hole;
+
+	for (moves = 0; moves < GLAMO_COMPACT_MOVES; moves++) {
+		hole = 0;
+		for (area = pGlamo->exa->offScreenAreas; area;
+		     area = area->next) {
+			if (area->state == ExaOffscreenAvail)
+				hole = max(hole, area->size);
+			else if (area->privData && hole >= area->size +
+				 pGlamo->exa->pixmapOffsetAlign)
+				break;
+		}
+		if (!area)
+			break;
+
+		priv = area->privData;
+		dst = GLAMOVRAMAllocAligned(pGlamo, GLAMO_VRAM_PIXMAPS,
+					    priv->size, priv->align);
+		if (!dst)
+			break;
+		if (dst->offset > area->offset) {
+			GLAMOVRAMFree(pGlamo, GLAMO_VRAM_PIXMAPS, dst);
+			break;
+		}
+
+		GLAMOVRAMCompactStart(pGlamo);
+		GLAMOExaMoveVRAM(pGlamo, dst->offset, area->offset, priv->size);
+		GLAMOFlushCMDQCache(pGlamo, 1);
+		/* Nothing may reuse the old area before it has been read. */
+		GLAMOEngineWait(pGlamo, GLAMO_ENGINE_ALL);
+
+		dst->privData = priv;
+		priv->area = dst;
+		priv->offset = dst->offset;
+		GLAMOVRAMFree(pGlamo, GLAMO_VRAM_PIXMAPS, area);
+	}
+
+	pGlamo->vram_fragmented = (moves == GLAMO_COMPACT_MOVES);
+}
+
+/* Offset in VRAM of a pixmap for which GLAMOPixmapInVRAM returned TRUE. */
+CARD32
+GLAMOPixmapOffset(PixmapPtr pPix)
+{
+	ScrnInfoPtr pScrn = xf86Screens[pPix->drawable.pScreen->myNum];
+	GlamoPtr pGlamo = GlamoPTR(pScrn);
+	GlamoPixmapPrivPtr priv;
+
+	if (!pGlamo->driver_pixmaps)
+		return exaGetPixmapOffset(pPix);
+
+	priv = exaGetPixmapDriverPrivate(pPix);
+	return priv->offset;
+}
+
+/* Moves the pixmap to VRAM if EXA manages it, and says whether it is. */
+Bool
+GLAMOPixmapInVRAM(GlamoPtr pGlamo, PixmapPtr pPix)
+{
+	GlamoPixmapPrivPtr priv;
+
+	if (pGlamo->driver_pixmaps) {
+		priv = exaGetPixmapDriverPrivate(pPix);
+		return priv && priv->in_vram;
+	}
+
+	exaMoveInPixmap(pPix);
+	return exaGetPixmapOffset(pPix) < pGlamo->exa->memorySize;
+}
+
+/*
+ * Note that the pixmap is used by the batch of commands being queued.
+ * Called when an operation is complete, just before its commands are
+ * dispatched, so the batch is the last one the operation went into.  If
+ * nothing is queued, no batch will be dispatched, and the last one
+ * dispatched is the last the operation can have used.
+ */
+void
+GLAMOPixmapFence(GlamoPtr pGlamo, PixmapPtr pPix)
+{
+	GlamoPixmapPrivPtr priv;
+
+	if (!pGlamo->driver_pixmaps)
+		return;
+
+	priv = exaGetPixmapDriverPrivate(pPix);
+	if (priv)
+		priv->fence = pGlamo->fence +
+			      (pGlamo->cmd_queue_cache->used ? 1 : 0);
+}
+
+/*
+ * Wait until the blitter is done with a pixmap before the CPU touches it.
+ * Pixmaps EXA allocates carry no fence, so for those wait for everything.
+ */
+void
+GLAMOPixmapWait(GlamoPtr pGlamo, PixmapPtr pPix)
+{
+	GlamoPixmapPrivPtr priv = NULL;
+
+	if (pGlamo->driver_pixmaps)
+		priv = exaGetPixmapDriverPrivate(pPix);
+
+	if (!priv) {
+		GLAMOEngineWait(pGlamo, GLAMO_ENGINE_ALL);
+		return;
+	}
+
+	if (GLAMOFenceRetired(pGlamo, priv->fence)) {
+		pGlamo->fence_skips++;
+		return;
+	}
+
+	GLAMOFenceWait(pGlamo, priv->fence);
+	pGlamo->fence_waits++;
+}
+
+/* Whether the CPU may touch a pixmap without waiting. */
+Bool
+GLAMOPixmapIdle(GlamoPtr pGlamo, PixmapPtr pPix)
+{
+	GlamoPixmapPrivPtr priv = NULL;
+
+	if (pGlamo->driver_pixmaps)
+		priv = exaGetPixmapDriverPrivate(pPix);
+
+	return GLAMOFenceRetired(pGlamo, priv ? priv->fence : pGlamo->fence);
+}
+
+/* Note that the blitter or the CPU changed part of a pixmap in VRAM. */
+void
+GLAMOPixmapDirty(GlamoPtr pGlamo, PixmapPtr pPix, int x1, int y1, int x2,
+		 int y2)
+{
+	GlamoPixmapPrivPtr priv;
+	BoxPtr dirty;
+
+	if (!pGlamo->driver_pixmaps)
+		return;
+
+	priv = exaGetPixmapDriverPrivate(pPix);
+	if (!priv)
+		return;
+	priv->solid = FALSE;
+	if (!priv->cache)
+		return;
+
+	dirty = &priv->dirty;
+	if (dirty->x1 >= dirty->x2 || dirty->y1 >= dirty->y2) {
+		dirty->x1 = x1;
+		dirty->y1 = y1;
+		dirty->x2 = x2;
+		dirty->y2 = y2;
+	} else {
+		dirty->x1 = min(dirty->x1, x1);
+		dirty->y1 = min(dirty->y1, y1);
+		dirty->x2 = max(dirty->x2, x2);
+		dirty->y2 = max(dirty->y2, y2);
+	}
+}
+
+/*
+ * The readback cache of a pixmap in VRAM, brought up to date, or NULL if
+ * it has none.  Pixmaps get one on their GLAMO_READBACK_HOT-th access.
+ */
+CARD8 *
+GLAMOPixmapCache(GlamoPtr pGlamo, PixmapPtr pPix)
+{
+	GlamoPixmapPrivPtr priv;
+	BoxPtr dirty;
+	int bpp = pPix->drawable.bitsPerPixel;
+	int pitch = pPix->devKind;
+	int x1, x2, y1, y2, offset;
+
+	if (!pGlamo->driver_pixmaps || !pGlamo->readback_budget)
+		return NULL;
+
+	priv = exaGetPixmapDriverPrivate(pPix);
+	if (!priv || !priv->in_vram)
+		return NULL;
+
+	if (!priv->cache) {
+		/* Pixmaps wrapped around memory not ours have no size. */
+		if (!priv->size || priv->size > GLAMO_READBACK_MAX_SIZE ||
+		    ++priv->accesses < GLAMO_READBACK_HOT ||
+		    pGlamo->readback_used + priv->size >
+		    pGlamo->readback_budget)
+			return NULL;
+
+		priv->cache = xalloc(priv->size);
+		if (!priv->cache)
+			return NULL;
+		pGlamo->readback_used += priv->size;
+
+		priv->dirty.x1 = 0;
+		priv->dirty.y1 = 0;
+		priv->dirty.x2 = pPix->drawable.width;
+		priv->dirty.y2 = pPix->drawable.height;
+	}
+
+	dirty = &priv->dirty;
+	x1 = max(dirty->x1, 0) * bpp / 8;
+	x2 = (min(dirty->x2, pPix->drawable.width) * bpp + 7) / 8;
+	y1 = max(dirty->y1, 0);
+	y2 = min(dirty->y2, pPix->drawable.height);
+
+	if (x1 < x2 && y1 < y2 && priv->solid) {
+		offset = y1 * pitch + x1;
+		GLAMOFillMemory(priv->cache + offset, pitch, bpp,
+				(x2 - x1) * 8 / bpp, y2 - y1, priv->solid_color);
+		pGlamo->solid_readbacks++;
+	} else if (x1 < x2 && y1 < y2) {
+		GLAMOPixmapWait(pGlamo, pPix);
+		offset = y1 * pitch + x1;
+		GLAMOTransferRect(pGlamo->download_row, priv->cache + offset,
+				  pitch, pGlamo->exa->memoryBase +
+				  priv->offset + offset, pitch,
+				  x2 - x1, y2 - y1);
+		pGlamo->readback_refreshed += (x2 - x1) * (y2 - y1);
+	}
+	dirty->x1 = dirty->y1 = dirty->x2 = dirty->y2 = 0;
+
+	pGlamo->readback_hits++;
+	return priv->cache;
+}
+
+/*
+ * Note whether a pixmap is now all of one colour.  Only pixmaps we
+ * allocated are tracked, as others may be drawn to behind our back.
+ */
+void
+GLAMOPixmapSolid(GlamoPtr pGlamo, PixmapPtr pPix, Bool solid, Pixel color)
+{
+	GlamoPixmapPrivPtr priv;
+
+	if (!pGlamo->driver_pixmaps)
+		return;
+
+	priv = exaGetPixmapDriverPrivate(pPix);
+	if (!priv || !priv->size || !priv->in_vram)
+		return;
+
+	priv->solid = solid;
+	priv->solid_color = color & FbFullMask(pPix->drawable.bitsPerPixel);
+}
+
+Bool
+GLAMOPixmapIsSolid(GlamoPtr pGlamo, PixmapPtr pPix, Pixel *color)
+{
+	GlamoPixmapPrivPtr priv;
+
+	if (!pGlamo->driver_pixmaps)
+		return FALSE;
+
+	priv = exaGetPixmapDriverPrivate(pPix);
+	if (!priv || !priv->solid)
+		return FALSE;
+
+	*color = priv->solid_color;
+	return TRUE;
+}
+
+/* Fill a rectangle of 8 or 16 bpp pixels in system memory. */
+void
+GLAMOFillMemory(CARD8 *dst, int pitch, int bpp, int w, int h, Pixel color)
+{
+	CARD16 *p;
+	int x;
+
+	for (; h; h--, dst += pitch) {
+		if (bpp == 8) {
+			memset(dst, color, w);
+			continue;
+		}
+		for (x = 0, p = (CARD16 *) dst; x < w; x++)
+			p[x] = color;
+	}
+}
@@ -419,6 +419,14 @@ enum glamo_reg_lcd_mode1 {
 	GLAMO_LCD_MODE1_ROTATE_EN	= 0x8000,
 };
 
+/* 2 bit pixels of the LCD cursor, four to a byte from the LSB up */
+enum glamo_lcd_cursor_pixel {
+	GLAMO_CURSOR_TRANSPARENT	= 0,
+	GLAMO_CURSOR_FG			= 1,
+	GLAMO_CURSOR_DST		= 2,
+	GLAMO_CURSOR_BG			= 3,
+};
+
 enum glamo_reg_lcd_mode2 {
 	GLAMO_LCD_MODE2_CRC_CHECK_EN	= 0x0001,
 	GLAMO_LCD_MODE2_DCMD_PER_LINE	= 0x0002,
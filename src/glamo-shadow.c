@@ -0,0 +1,236 @@
+/*
+ * Copyright  2007 OpenMoko, Inc.
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation, and
+ * that the name of the copyright holders not be used in advertising or
+ * publicity pertaining to distribution of the software without specific,
+ * written prior permission.  The copyright holders make no representations
+ * about the suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO
+ * EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE,
+ * DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER
+ * TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+ * OF THIS SOFTWARE.
+ */
+
+
+/*
+ * Shadow framebuffer.  With the ShadowFB option the screen pixmap lives in
+ * cached system memory, where software rendering runs much faster than in
+ * VRAM.  The shadow layer collects what was drawn to the screen and, just
+ * before the server blocks, has the damaged boxes copied to the scanout
+ * buffer here.
+ *
+ * Copies from offscreen pixmaps to the screen are still blitted, straight
+ * to the scanout, since doing them in software would read the pixmaps
+ * from uncached VRAM.  What the blitter drew there is newer than the
+ * shadow, so it is left out of the updates and only read back into the
+ * shadow before software next touches the screen.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+#include "glamo.h"
+#include "fbdevhw.h"
+
+/* Boxes covering this much of a row are copied as whole rows. */
+#define GLAMO_SHADOW_ROW_FRACTION(row)	((row) * 3 / 4)
+
+Bool
+GLAMOShadowIsScreen(GlamoPtr pGlamo, PixmapPtr pPix)
+{
+	GlamoPixmapPrivPtr priv;
+
+	if (!pGlamo->shadowFB || !pGlamo->driver_pixmaps)
+		return FALSE;
+
+	priv = exaGetPixmapDriverPrivate(pPix);
+	return priv && priv->sys && priv->sys == pGlamo->shadow;
+}
+
+/*
+ * Whether copies to the screen can be blitted to the scanout, which the
+ * 2D engine sees at the offset of the screen pixmap.  After RandR has
+ * reshaped the screen, the scanout may have another pitch than the shadow.
+ */
+Bool
+GLAMOShadowCanBlit(GlamoPtr pGlamo, PixmapPtr pDst)
+{
+	ScrnInfoPtr pScrn = xf86Screens[pDst->drawable.pScreen->myNum];
+
+	return pDst->devKind == fbdevHWGetLineLength(pScrn);
+}
+
+/* Note that the blitter drew a box of the scanout. */
+void
+GLAMOShadowBlitted(GlamoPtr pGlamo, int x1, int y1, int x2, int y2)
+{
+	ScreenPtr pScreen = pGlamo->pScreen;
+	RegionRec region;
+	BoxRec box;
+
+	box.x1 = x1;
+	box.y1 = y1;
+	box.x2 = x2;
+	box.y2 = y2;
+	REGION_INIT(pScreen, &region, &box, 1);
+	REGION_UNION(pScreen, &pGlamo->shadow_stale, &pGlamo->shadow_stale,
+		     &region);
+	REGION_UNINIT(pScreen, &region);
+}
+
+/* Bring the shadow up to date with what the blitter drew to the scanout. */
+void
+GLAMOShadowSync(GlamoPtr pGlamo, PixmapPtr pPix)
+{
+	ScreenPtr pScreen = pGlamo->pScreen;
+	ScrnInfoPtr pScrn = xf86Screens[pScreen->myNum];
+	RegionPtr stale = &pGlamo->shadow_stale;
+	BoxPtr pbox = REGION_RECTS(stale);
+	int nbox = REGION_NUM_RECTS(stale);
+	int pitch = pPix->devKind;
+	int fb_pitch = fbdevHWGetLineLength(pScrn);
+	int cpp = pPix->drawable.bitsPerPixel / 8;
+	unsigned long pixels = 0, bytes = 0;
+
+	if (!REGION_NOTEMPTY(pScreen, stale))
+		return;
+
+	GLAMOStatBegin(pGlamo, GLAMO_STAT_SHADOW_READBACK);
+
+	/* The blitter may still be drawing there. */
+	GLAMOPixmapWait(pGlamo, pPix);
+
+	for (; nbox--; pbox++) {
+		int x1 = max(pbox->x1, 0), y1 = max(pbox->y1, 0);
+		int x2 = min(pbox->x2, pPix->drawable.width);
+		int y2 = min(pbox->y2, pPix->drawable.height);
+
+		if (x1 >= x2 || y1 >= y2)
+			continue;
+
+		GLAMOTransferRect(pGlamo->download_row,
+				  (CARD8 *)pGlamo->shadow + y1 * pitch + x1 * cpp,
+				  pitch,
+				  pGlamo->fbstart + y1 * fb_pitch + x1 * cpp,
+				  fb_pitch, (x2 - x1) * cpp, y2 - y1);
+		pixels += (x2 - x1) * (y2 - y1);
+		bytes += (x2 - x1) * (y2 - y1) * cpp;
+	}
+
+	REGION_EMPTY(pScreen, stale);
+
+	GLAMOStatEnd(pGlamo, GLAMO_STAT_SHADOW_READBACK, pixels, bytes);
+}
+
+static unsigned long
+GLAMOShadowCopy(GlamoPtr pGlamo, int pitch, int fb_pitch, int x1, int y1,
+		int x2, int y2)
+{
+	CARD8 *src = (CARD8 *)pGlamo->shadow + y1 * pitch + x1;
+	CARD8 *dst = pGlamo->fbstart + y1 * fb_pitch + x1;
+
+	GLAMOTransferRect(pGlamo->upload_row, dst, fb_pitch, src, pitch,
+			  x2 - x1, y2 - y1);
+
+	return (unsigned long)(x2 - x1) * (y2 - y1);
+}
+
+/* Whether widening a box, given in bytes, leaves what was blitted alone. */
+static Bool
+GLAMOShadowCanWiden(GlamoPtr pGlamo, int cpp, int x1, int y1, int x2, int y2)
+{
+	BoxRec box;
+
+	if (!REGION_NOTEMPTY(pGlamo->pScreen, &pGlamo->shadow_stale))
+		return TRUE;
+
+	box.x1 = x1 / cpp;
+	box.y1 = y1;
+	box.x2 = (x2 + cpp - 1) / cpp;
+	box.y2 = y2;
+	return RECT_IN_REGION(pGlamo->pScreen, &pGlamo->shadow_stale,
+			      &box) == rgnOUT;
+}
+
+/*
+ * Spans are widened to whole 32 bit words so the transfer loops run
+ * aligned.  Wide boxes are widened to whole rows, and runs of those which
+ * touch are copied as one block.  Nothing is widened over pixels the
+ * blitter drew.
+ */
+void
+GLAMOShadowUpdate(ScreenPtr pScreen, shadowBufPtr pBuf)
+{
+	ScrnInfoPtr pScrn = xf86Screens[pScreen->myNum];
+	GlamoPtr pGlamo = GlamoPTR(pScrn);
+	PixmapPtr pShadow = pBuf->pPixmap;
+	RegionRec damage;
+	BoxPtr pbox;
+	int nbox;
+	int pitch = pShadow->devKind;
+	int fb_pitch = fbdevHWGetLineLength(pScrn);
+	int cpp = pShadow->drawable.bitsPerPixel / 8;
+	int row = min(pShadow->drawable.width * cpp, min(pitch, fb_pitch));
+	int run_y1 = 0, run_y2 = 0;
+	unsigned long pixels = 0, bytes = 0;
+
+	GLAMOStatBegin(pGlamo, GLAMO_STAT_SHADOW);
+
+	REGION_NULL(pScreen, &damage);
+	REGION_SUBTRACT(pScreen, &damage, shadowDamage(pBuf),
+			&pGlamo->shadow_stale);
+	pbox = REGION_RECTS(&damage);
+	nbox = REGION_NUM_RECTS(&damage);
+
+	for (; nbox--; pbox++) {
+		int x1 = (pbox->x1 * cpp) & ~3;
+		int x2 = min((pbox->x2 * cpp + 3) & ~3, row);
+
+		pixels += (pbox->x2 - pbox->x1) * (pbox->y2 - pbox->y1);
+
+		if (!GLAMOShadowCanWiden(pGlamo, cpp, x1, pbox->y1, x2,
+					 pbox->y2)) {
+			bytes += GLAMOShadowCopy(pGlamo, pitch, fb_pitch,
+						 pbox->x1 * cpp, pbox->y1,
+						 pbox->x2 * cpp, pbox->y2);
+			continue;
+		}
+
+		if (x2 - x1 < GLAMO_SHADOW_ROW_FRACTION(row) ||
+		    !GLAMOShadowCanWiden(pGlamo, cpp, 0, pbox->y1, row,
+					 pbox->y2)) {
+			bytes += GLAMOShadowCopy(pGlamo, pitch, fb_pitch,
+						 x1, pbox->y1, x2, pbox->y2);
+			continue;
+		}
+
+		/* The boxes are sorted by their top row. */
+		if (run_y2 > run_y1 && pbox->y1 <= run_y2) {
+			run_y2 = max(run_y2, pbox->y2);
+			continue;
+		}
+
+		if (run_y2 > run_y1)
+			bytes += GLAMOShadowCopy(pGlamo, pitch, fb_pitch,
+						 0, run_y1, row, run_y2);
+		run_y1 = pbox->y1;
+		run_y2 = pbox->y2;
+	}
+
+	if (run_y2 > run_y1)
+		bytes += GLAMOShadowCopy(pGlamo, pitch, fb_pitch, 0, run_y1,
+					 row, run_y2);
+
+	REGION_UNINIT(pScreen, &damage);
+
+	GLAMOStatEnd(pGlamo, GLAMO_STAT_SHADOW, pixels, bytes);
+}
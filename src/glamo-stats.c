@@ -0,0 +1,323 @@
+/*
+ * Copyright  2007 OpenMoko, Inc.
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation, and
+ * that the name of the copyright holders not be used in advertising or
+ * publicity pertaining to distribution of the software without specific,
+ * written prior permission.  The copyright holders make no representations
+ * about the suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO
+ * EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE,
+ * DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER
+ * TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+ * OF THIS SOFTWARE.
+ */
+
+/*
+ * Acceleration statistics.  Every accelerated operation counts its calls,
+ * the pixels it touched and the bytes it moved over the bus, and with the
+ * StatsTiming option the time it took.  Operations left to software count
+ * their reason.  The counters are published as the GlamoStats property
+ * of the LCD output, so "xrandr --prop" shows them while the server runs,
+ * and are logged when the screen is closed.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+#include <stdio.h>
+#include <string.h>
+#include <X11/Xatom.h>
+#include "glamo.h"
+
+/* Fallbacks are logged at most this often, in milliseconds. */
+#define GLAMO_FALLBACK_LOG_INTERVAL	10000
+
+/* The property is refreshed at most this often, in milliseconds. */
+#define GLAMO_STATS_UPDATE_INTERVAL	1000
+
+#define GLAMO_STATS_TEXT_SIZE		4096
+
+static const char *GLAMOStatNames[NB_GLAMO_STATS] = {
+	"solid",
+	"copy",
+	"composite",
+	"upload",
+	"download",
+	"glyphs",
+	"bitmap",
+	"pattern fill",
+	"shadow update",
+	"shadow readback",
+};
+
+static const char *GLAMOFallbackNames[NB_GLAMO_FALLBACKS] = {
+	"bits per pixel",
+	"planemask",
+	"overlapping pixmaps at 8bpp or with different pitches",
+	"odd 8bpp pitch or offset",
+	"pitch too large for the 2D engine",
+	"screen in the shadow framebuffer",
+};
+
+static const char *GLAMOCostOpNames[NB_GLAMO_COST_OPS] = {
+	"solid",
+	"copy",
+};
+
+static const char *GLAMOCompositeModeNames[NB_GLAMO_COMPOSITE_MODES] = {
+	"copy",
+	"fill",
+	"no-op",
+	"CPU blend",
+	"CPU conversion",
+	"tile",
+};
+
+static const char *GLAMOCompositeFallbackNames[NB_GLAMO_COMPOSITE_FALLBACKS] = {
+	"operator",
+	"mask",
+	"source picture",
+	"alpha map",
+	"transform",
+	"repeat",
+	"source format",
+	"destination format",
+	"translucent source",
+	"prepare failed",
+	"screen in the shadow framebuffer",
+};
+
+void
+GLAMOStatBegin(GlamoPtr pGlamo, enum GLAMOStat stat)
+{
+	if (pGlamo->stats_timing)
+		gettimeofday(&pGlamo->stats[stat].start, NULL);
+}
+
+/*
+ * Count a completed operation.  Operations which give up between
+ * GLAMOStatBegin and here aren't counted.
+ */
+void
+GLAMOStatEnd(GlamoPtr pGlamo, enum GLAMOStat stat, unsigned long pixels,
+	     unsigned long bytes)
+{
+	GlamoStatPtr s = &pGlamo->stats[stat];
+	struct timeval now;
+
+	s->calls++;
+	s->pixels += pixels;
+	s->bytes += bytes;
+
+	if (pGlamo->stats_timing) {
+		gettimeofday(&now, NULL);
+		s->usec += (now.tv_sec - s->start.tv_sec) * 1000000 +
+			   now.tv_usec - s->start.tv_usec;
+	}
+}
+
+void
+GLAMOStatFallback(GlamoPtr pGlamo, enum GLAMOFallback reason)
+{
+	CARD32 now = GetTimeInMillis();
+	unsigned long total = 0;
+	int i;
+
+	pGlamo->fallbacks[reason]++;
+
+	if (pGlamo->fallbacks_logged &&
+	    now - pGlamo->fallback_log_time < GLAMO_FALLBACK_LOG_INTERVAL)
+		return;
+
+	for (i = 0; i < NB_GLAMO_FALLBACKS; i++)
+		total += pGlamo->fallbacks[i];
+
+	xf86DrvMsgVerb(pGlamo->pScreen->myNum, X_INFO, 3,
+		       "%lu software fallbacks since the last report, the "
+		       "latest due to %s\n", total - pGlamo->fallbacks_logged,
+		       GLAMOFallbackNames[reason]);
+	pGlamo->fallbacks_logged = total;
+	pGlamo->fallback_log_time = now;
+}
+
+static int
+GLAMOStatsFormat(GlamoPtr pGlamo, char *text, int size)
+{
+	GlamoStatPtr s;
+	int i, n = 0;
+
+	for (i = 0; i < NB_GLAMO_STATS && n < size; i++) {
+		s = &pGlamo->stats[i];
+		n += snprintf(text + n, size - n, "%s: %lu calls, %lu pixels, "
+			      "%lu bytes, %lu ms\n", GLAMOStatNames[i],
+			      s->calls, s->pixels, s->bytes, s->usec / 1000);
+	}
+	for (i = 0; i < NB_GLAMO_FALLBACKS && n < size; i++)
+		n += snprintf(text + n, size - n, "fallback due to %s: %lu\n",
+			      GLAMOFallbackNames[i], pGlamo->fallbacks[i]);
+	for (i = 0; i < NB_GLAMO_COST_OPS && n < size; i++)
+		n += snprintf(text + n, size - n, "%s on the CPU up to %d "
+			      "pixels: %lu boxes, %lu pixels, %lu small boxes "
+			      "blitted\n", GLAMOCostOpNames[i],
+			      pGlamo->cost[i].cpu_max, pGlamo->cost[i].cpu_boxes,
+			      pGlamo->cost[i].cpu_pixels, pGlamo->cost[i].busy);
+	if (n < size)
+		n += snprintf(text + n, size - n, "solid pixmaps: %lu fills "
+			      "dropped, %lu copies filled, %lu readbacks "
+			      "filled\n", pGlamo->solid_fills_dropped,
+			      pGlamo->solid_copies_filled,
+			      pGlamo->solid_readbacks);
+	if (n < size)
+		n += snprintf(text + n, size - n, "boxes merged: %lu solid, "
+			      "%lu copy\n", pGlamo->solid_merged,
+			      pGlamo->copy_merged);
+	if (n < size)
+		n += snprintf(text + n, size - n, "conversions read from: "
+			      "%lu readback caches, %lu VRAM\n",
+			      pGlamo->convert_cached, pGlamo->convert_vram);
+	for (i = 0; i < NB_GLAMO_COMPOSITE_MODES && n < size; i++)
+		n += snprintf(text + n, size - n,
+			      "composite accelerated as %s: %lu\n",
+			      GLAMOCompositeModeNames[i],
+			      pGlamo->composite_accel[i]);
+	for (i = 0; i < NB_GLAMO_COMPOSITE_FALLBACKS && n < size; i++)
+		n += snprintf(text + n, size - n,
+			      "composite fallback due to %s: %lu\n",
+			      GLAMOCompositeFallbackNames[i],
+			      pGlamo->composite_fallback[i]);
+
+	return min(n, size - 1);
+}
+
+/* Sum of all counters, to tell whether anything happened. */
+static unsigned long
+GLAMOStatsSum(GlamoPtr pGlamo)
+{
+	unsigned long sum = 0;
+	int i;
+
+	for (i = 0; i < NB_GLAMO_STATS; i++)
+		sum += pGlamo->stats[i].calls;
+	for (i = 0; i < NB_GLAMO_FALLBACKS; i++)
+		sum += pGlamo->fallbacks[i];
+	for (i = 0; i < NB_GLAMO_COST_OPS; i++)
+		sum += pGlamo->cost[i].cpu_boxes + pGlamo->cost[i].busy;
+	sum += pGlamo->solid_fills_dropped + pGlamo->solid_copies_filled +
+	       pGlamo->solid_readbacks;
+	sum += pGlamo->solid_merged + pGlamo->copy_merged;
+	sum += pGlamo->convert_cached + pGlamo->convert_vram;
+	for (i = 0; i < NB_GLAMO_COMPOSITE_FALLBACKS; i++)
+		sum += pGlamo->composite_fallback[i];
+
+	return sum;
+}
+
+static void
+GLAMOStatsPublish(GlamoPtr pGlamo)
+{
+	char text[GLAMO_STATS_TEXT_SIZE];
+	int n;
+
+	n = GLAMOStatsFormat(pGlamo, text, sizeof(text));
+	RRChangeOutputProperty(pGlamo->stats_output->randr_output,
+			       pGlamo->stats_atom, XA_STRING, 8,
+			       PropModeReplace, n, text, FALSE, FALSE);
+}
+
+/* Called from the output's create_resources hook. */
+void
+GLAMOStatsOutputInit(xf86OutputPtr output)
+{
+	GlamoPtr pGlamo = GlamoPTR(output->scrn);
+	static const char name[] = "GlamoStats";
+	int err;
+
+	pGlamo->stats_atom = MakeAtom(name, sizeof(name) - 1, TRUE);
+	err = RRConfigureOutputProperty(output->randr_output,
+					pGlamo->stats_atom, FALSE, FALSE,
+					TRUE, 0, NULL);
+	if (err) {
+		xf86DrvMsg(output->scrn->scrnIndex, X_WARNING,
+			   "Couldn't create the %s property: %d\n", name, err);
+		return;
+	}
+
+	pGlamo->stats_output = output;
+	GLAMOStatsPublish(pGlamo);
+}
+
+/* Refresh the property from the block handler when anything changed. */
+void
+GLAMOStatsUpdate(GlamoPtr pGlamo)
+{
+	CARD32 now;
+	unsigned long sum;
+
+	if (!pGlamo->stats_output)
+		return;
+
+	now = GetTimeInMillis();
+	if (now - pGlamo->stats_time < GLAMO_STATS_UPDATE_INTERVAL)
+		return;
+	pGlamo->stats_time = now;
+
+	sum = GLAMOStatsSum(pGlamo);
+	if (sum == pGlamo->stats_sum)
+		return;
+	pGlamo->stats_sum = sum;
+
+	GLAMOStatsPublish(pGlamo);
+}
+
+void
+GLAMOStatsReport(GlamoPtr pGlamo)
+{
+	int scrnIndex = pGlamo->pScreen->myNum;
+	GlamoStatPtr s;
+	int i;
+
+	for (i = 0; i < NB_GLAMO_STATS; i++) {
+		s = &pGlamo->stats[i];
+		if (!s->calls)
+			continue;
+		xf86DrvMsg(scrnIndex, X_INFO, "Accelerated %s: %lu calls, "
+			   "%lu pixels, %lu bytes, %lu ms\n", GLAMOStatNames[i],
+			   s->calls, s->pixels, s->bytes, s->usec / 1000);
+	}
+	for (i = 0; i < NB_GLAMO_FALLBACKS; i++)
+		xf86DrvMsg(scrnIndex, X_INFO, "Fallback due to %s: %lu\n",
+			   GLAMOFallbackNames[i], pGlamo->fallbacks[i]);
+	for (i = 0; i < NB_GLAMO_COST_OPS; i++)
+		xf86DrvMsg(scrnIndex, X_INFO, "Small %ss on the CPU: %lu "
+			   "boxes, %lu pixels; blitted as the pixmap was busy "
+			   "or the raster op not a copy: %lu\n",
+			   GLAMOCostOpNames[i], pGlamo->cost[i].cpu_boxes,
+			   pGlamo->cost[i].cpu_pixels, pGlamo->cost[i].busy);
+	xf86DrvMsg(scrnIndex, X_INFO, "Pixmaps known to be solid: %lu fills "
+		   "dropped, %lu copies done as fills, %lu readbacks filled "
+		   "in without VRAM\n", pGlamo->solid_fills_dropped,
+		   pGlamo->solid_copies_filled, pGlamo->solid_readbacks);
+	xf86DrvMsg(scrnIndex, X_INFO, "Boxes merged into others: %lu solid, "
+		   "%lu copy\n", pGlamo->solid_merged, pGlamo->copy_merged);
+	xf86DrvMsg(scrnIndex, X_INFO, "Sources of CPU conversions read from "
+		   "readback caches: %lu, from VRAM: %lu\n",
+		   pGlamo->convert_cached, pGlamo->convert_vram);
+	for (i = 0; i < NB_GLAMO_COMPOSITE_MODES; i++)
+		xf86DrvMsg(scrnIndex, X_INFO,
+			   "Composite accelerated as %s: %lu\n",
+			   GLAMOCompositeModeNames[i],
+			   pGlamo->composite_accel[i]);
+	for (i = 0; i < NB_GLAMO_COMPOSITE_FALLBACKS; i++)
+		xf86DrvMsg(scrnIndex, X_INFO,
+			   "Composite fallback due to %s: %lu\n",
+			   GLAMOCompositeFallbackNames[i],
+			   pGlamo->composite_fallback[i]);
+}
@@ -0,0 +1,328 @@
+/*
+ * Copyright  2007 OpenMoko, Inc.
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation, and
+ * that the name of the copyright holders not be used in advertising or
+ * publicity pertaining to distribution of the software without specific,
+ * written prior permission.  The copyright holders make no representations
+ * about the suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO
+ * EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE,
+ * DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER
+ * TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+ * OF THIS SOFTWARE.
+ */
+
+/*
+ * Copy loops for moving pixels between system memory and VRAM.  VRAM is
+ * mapped uncached and sits on a 16 bit bus, so what matters is issuing
+ * few, large bursts.  The best loop the CPU supports is picked when
+ * acceleration is set up.  Likewise for converting 32 bit pixels to
+ * r5g6b5 on their way into VRAM, with optional ordered dithering.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include "glamo.h"
+
+#if defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
+/* 4x4 ordered dither matrix */
+static const CARD8 GLAMODitherMatrix[4][4] = {
+	{  0,  8,  2, 10 },
+	{ 12,  4, 14,  6 },
+	{  3, 11,  1,  9 },
+	{ 15,  7, 13,  5 },
+};
+
+static void
+GLAMOCopyRowC(CARD8 *dst, const CARD8 *src, int n)
+{
+	memcpy(dst, src, n);
+}
+
+static inline CARD16
+GLAMOConvertPixel(CARD32 p)
+{
+	return ((p >> 8) & 0xf800) | ((p >> 5) & 0x07e0) | ((p >> 3) & 0x001f);
+}
+
+/*
+ * Without dithering, pixels are stored in pairs, halving the writes to
+ * uncached VRAM.  Dithering adds up to just below one step of each
+ * channel before truncating it.
+ */
+static void
+GLAMOConvertRowC(CARD16 *dst, const CARD32 *src, int n, const CARD8 *dither)
+{
+	CARD32 p, r, g, b, d;
+	int i;
+
+	if (dither) {
+		for (i = 0; i < n; i++) {
+			p = src[i];
+			d = dither[i & 7];
+			r = min(((p >> 16) & 0xff) + (d >> 1), 0xff);
+			g = min(((p >> 8) & 0xff) + (d >> 2), 0xff);
+			b = min((p & 0xff) + (d >> 1), 0xff);
+			dst[i] = (r & 0xf8) << 8 | (g & 0xfc) << 3 | b >> 3;
+		}
+		return;
+	}
+
+	if (((unsigned long)dst & 2) && n) {
+		*dst++ = GLAMOConvertPixel(*src++);
+		n--;
+	}
+
+	for (; n >= 2; n -= 2, src += 2, dst += 2) {
+#if X_BYTE_ORDER == X_BIG_ENDIAN
+		*(CARD32 *)dst = GLAMOConvertPixel(src[0]) << 16 |
+				 GLAMOConvertPixel(src[1]);
+#else
+		*(CARD32 *)dst = GLAMOConvertPixel(src[0]) |
+				 GLAMOConvertPixel(src[1]) << 16;
+#endif
+	}
+
+	if (n)
+		*dst = GLAMOConvertPixel(*src);
+}
+
+#if defined(__arm__) && !defined(__thumb__)
+/*
+ * Moves 32 bytes per iteration with two ldm/stm pairs once both pointers
+ * are word aligned.  Rows with mismatched alignment go to memcpy.
+ */
+static inline void
+GLAMOCopyRowLdm(CARD8 *dst, const CARD8 *src, int n, Bool prefetch)
+{
+	if (((unsigned long)dst ^ (unsigned long)src) & 3) {
+		memcpy(dst, src, n);
+		return;
+	}
+
+	while (((unsigned long)dst & 3) && n) {
+		*dst++ = *src++;
+		n--;
+	}
+
+	while (n >= 32) {
+#ifdef GLAMO_HAVE_PLD
+		if (prefetch)
+			__asm__ __volatile__("pld [%0, #64]" : : "r" (src));
+#endif
+		__asm__ __volatile__(
+			"ldmia %0!, {r3, r4, r5, r6}\n\t"
+			"stmia %1!, {r3, r4, r5, r6}\n\t"
+			"ldmia %0!, {r3, r4, r5, r6}\n\t"
+			"stmia %1!, {r3, r4, r5, r6}"
+			: "+r" (src), "+r" (dst)
+			:
+			: "r3", "r4", "r5", "r6", "memory");
+		n -= 32;
+	}
+
+	if (n)
+		memcpy(dst, src, n);
+}
+
+static void
+GLAMOCopyRowArm(CARD8 *dst, const CARD8 *src, int n)
+{
+	GLAMOCopyRowLdm(dst, src, n, FALSE);
+}
+
+#ifdef GLAMO_HAVE_PLD
+static void
+GLAMOCopyRowArmPld(CARD8 *dst, const CARD8 *src, int n)
+{
+	GLAMOCopyRowLdm(dst, src, n, TRUE);
+}
+#endif
+#endif /* __arm__ */
+
+#if defined(__ARM_NEON__)
+/* 64 bytes per iteration through four q registers. */
+static inline void
+GLAMOCopyRowNeonLoop(CARD8 *dst, const CARD8 *src, int n, Bool prefetch)
+{
+	uint8x16_t a, b, c, d;
+
+	while (n >= 64) {
+		if (prefetch)
+			__builtin_prefetch(src + 128);
+		a = vld1q_u8(src);
+		b = vld1q_u8(src + 16);
+		c = vld1q_u8(src + 32);
+		d = vld1q_u8(src + 48);
+		vst1q_u8(dst, a);
+		vst1q_u8(dst + 16, b);
+		vst1q_u8(dst + 32, c);
+		vst1q_u8(dst + 48, d);
+		src += 64;
+		dst += 64;
+		n -= 64;
+	}
+
+	if (n)
+		memcpy(dst, src, n);
+}
+
+static void
+GLAMOCopyRowNeon(CARD8 *dst, const CARD8 *src, int n)
+{
+	GLAMOCopyRowNeonLoop(dst, src, n, FALSE);
+}
+
+static void
+GLAMOCopyRowNeonPld(CARD8 *dst, const CARD8 *src, int n)
+{
+	GLAMOCopyRowNeonLoop(dst, src, n, TRUE);
+}
+
+/*
+ * Eight pixels at a time: the channels are deinterleaved by vld4, and
+ * shifted into place with vsri, which keeps the bits above those inserted.
+ */
+static void
+GLAMOConvertRowNeon(CARD16 *dst, const CARD32 *src, int n,
+		    const CARD8 *dither)
+{
+	uint8x8_t d5 = vdup_n_u8(0), d6 = vdup_n_u8(0);
+	uint8x8x4_t s;
+	uint16x8_t p;
+
+	if (dither) {
+		d5 = vshr_n_u8(vld1_u8(dither), 1);
+		d6 = vshr_n_u8(vld1_u8(dither), 2);
+	}
+
+	while (n >= 8) {
+		__builtin_prefetch(src + 32);
+		s = vld4_u8((const uint8_t *)src);
+		p = vshll_n_u8(vqadd_u8(s.val[2], d5), 8);
+		p = vsriq_n_u16(p, vshll_n_u8(vqadd_u8(s.val[1], d6), 8), 5);
+		p = vsriq_n_u16(p, vshll_n_u8(vqadd_u8(s.val[0], d5), 8), 11);
+		vst1q_u16(dst, p);
+		src += 8;
+		dst += 8;
+		n -= 8;
+	}
+
+	GLAMOConvertRowC(dst, src, n, dither);
+}
+
+/* NEON is optional on ARMv7, so ask the kernel whether we have it. */
+Bool
+GLAMOHaveNeon(void)
+{
+	unsigned long aux[2];
+	Bool neon = FALSE;
+	int fd;
+
+	fd = open("/proc/self/auxv", O_RDONLY);
+	if (fd < 0)
+		return FALSE;
+
+	while (read(fd, aux, sizeof(aux)) == sizeof(aux) && aux[0]) {
+		if (aux[0] == 16 /* AT_HWCAP */) {
+			neon = (aux[1] & (1 << 12) /* HWCAP_NEON */) != 0;
+			break;
+		}
+	}
+	close(fd);
+
+	return neon;
+}
+#endif /* __ARM_NEON__ */
+
+void
+GLAMOTransferInit(ScrnInfoPtr pScrn)
+{
+	GlamoPtr pGlamo = GlamoPTR(pScrn);
+
+	pGlamo->upload_row = GLAMOCopyRowC;
+	pGlamo->download_row = GLAMOCopyRowC;
+	pGlamo->convert_row = GLAMOConvertRowC;
+	pGlamo->transfer_name = "C";
+
+#if defined(__arm__) && !defined(__thumb__)
+	pGlamo->upload_row = GLAMOCopyRowArm;
+	pGlamo->download_row = GLAMOCopyRowArm;
+	pGlamo->transfer_name = "ARM ldm/stm";
+#ifdef GLAMO_HAVE_PLD
+	pGlamo->download_row = GLAMOCopyRowArmPld;
+	pGlamo->transfer_name = "ARMv5 ldm/stm with pld";
+#endif
+#endif
+
+#if defined(__ARM_NEON__)
+	if (GLAMOHaveNeon()) {
+		pGlamo->upload_row = GLAMOCopyRowNeon;
+		pGlamo->download_row = GLAMOCopyRowNeonPld;
+		pGlamo->convert_row = GLAMOConvertRowNeon;
+		pGlamo->transfer_name = "NEON";
+	}
+#endif
+
+	xf86DrvMsg(pScrn->scrnIndex, X_INFO, "Using %s pixel transfer loops\n",
+		   pGlamo->transfer_name);
+}
+
+/*
+ * Copy a rectangle of h rows of n bytes.  When neither side has padding
+ * between the rows the rectangle is copied as a single block.
+ */
+void
+GLAMOTransferRect(GlamoCopyRowProc copy, CARD8 *dst, int dst_pitch,
+		  const CARD8 *src, int src_pitch, int n, int h)
+{
+	if (dst_pitch == n && src_pitch == n) {
+		copy(dst, src, n * h);
+		return;
+	}
+
+	while (h--) {
+		copy(dst, src, n);
+		dst += dst_pitch;
+		src += src_pitch;
+	}
+}
+
+/*
+ * Convert a rectangle of x8r8g8b8 pixels to r5g6b5 as it is written to
+ * VRAM.  The dither pattern is anchored at x, y in the destination.
+ */
+void
+GLAMOConvertRect(GlamoPtr pGlamo, CARD8 *dst, int dst_pitch,
+		 const CARD8 *src, int src_pitch, int x, int y, int w, int h)
+{
+	CARD8 pattern[8];
+	int i;
+
+	while (h--) {
+		if (pGlamo->dither) {
+			for (i = 0; i < 8; i++)
+				pattern[i] = GLAMODitherMatrix[y & 3][(x + i) & 3];
+		}
+		pGlamo->convert_row((CARD16 *)dst, (const CARD32 *)src, w,
+				    pGlamo->dither ? pattern : NULL);
+		dst += dst_pitch;
+		src += src_pitch;
+		y++;
+	}
+}
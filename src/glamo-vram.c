@@ -0,0 +1,201 @@
+/*
+ * Copyright  2007 OpenMoko, Inc.
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation, and
+ * that the name of the copyright holders not be used in advertising or
+ * publicity pertaining to distribution of the software without specific,
+ * written prior permission.  The copyright holders make no representations
+ * about the suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO
+ * EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE,
+ * DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER
+ * TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+ * OF THIS SOFTWARE.
+ */
+
+/*
+ * VRAM budget.  The framebuffer device tells us how much of VRAM we may
+ * use; the scanout buffer sits at its start and everything after it is
+ * handed to EXA.  Buffers the driver itself keeps for the lifetime of the
+ * screen are allocated from the EXA heap through here, so they are
+ * accounted per user, and the rest is left for pixmaps.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+#include "glamo.h"
+
+static const char *GLAMOVRAMClientNames[NB_GLAMO_VRAM_CLIENTS] = {
+	"command queue",
+	"mono cache",
+	"upload ring",
+	"cursor",
+	"pixmaps",
+};
+
+/*
+ * Size EXA from the framebuffer aperture.  Must be called before
+ * exaDriverInit.
+ */
+Bool
+GLAMOVRAMInit(ScrnInfoPtr pScrn, ExaDriverPtr exa)
+{
+	GlamoPtr pGlamo = GlamoPTR(pScrn);
+	unsigned long size, scanout;
+	int cpp = pScrn->bitsPerPixel / 8;
+
+	size = pGlamo->fb_fix.smem_len - pGlamo->fboff;
+	if (size > GLAMO_VRAM_MAX)
+		size = GLAMO_VRAM_MAX;
+
+	scanout = max(pScrn->virtualX * pScrn->virtualY,
+		      pScrn->displayWidth * pScrn->virtualY) * cpp;
+	scanout = (scanout + exa->pixmapOffsetAlign - 1) &
+		  ~(exa->pixmapOffsetAlign - 1);
+
+	if (scanout >= size) {
+		xf86DrvMsg(pScrn->scrnIndex, X_ERROR,
+			   "No VRAM left after the %lukB scanout buffer\n",
+			   scanout / 1024);
+		return FALSE;
+	}
+
+	exa->memorySize = size;
+	exa->offScreenBase = scanout;
+
+	pGlamo->vram_size = size;
+	pGlamo->vram_scanout = scanout;
+
+	xf86DrvMsg(pScrn->scrnIndex, X_INFO,
+		   "VRAM: %lukB usable, %lukB for scanout, %lukB offscreen\n",
+		   size / 1024, scanout / 1024, (size - scanout) / 1024);
+
+	return TRUE;
+}
+
+/* Allocate a locked offscreen area on behalf of one of the driver's users. */
+ExaOffscreenArea *
+GLAMOVRAMAlloc(GlamoPtr pGlamo, enum GLAMOVRAMClient client, int size)
+{
+	return GLAMOVRAMAllocAligned(pGlamo, client, size,
+				     pGlamo->exa->pixmapOffsetAlign);
+}
+
+ExaOffscreenArea *
+GLAMOVRAMAllocAligned(GlamoPtr pGlamo, enum GLAMOVRAMClient client, int size,
+		      int align)
+{
+	ExaOffscreenArea *area;
+
+	area = exaOffscreenAlloc(pGlamo->pScreen, size, align,
+				 TRUE, NULL, NULL);
+	/* Running out of room for pixmaps is normal. */
+	if (!area && client != GLAMO_VRAM_PIXMAPS) {
+		xf86DrvMsg(pGlamo->pScreen->myNum, X_WARNING,
+			   "Couldn't allocate %dkB of VRAM for the %s\n",
+			   size / 1024, GLAMOVRAMClientNames[client]);
+		return NULL;
+	}
+	if (!area)
+		return NULL;
+
+	pGlamo->vram_used[client] += area->size;
+
+	return area;
+}
+
+void
+GLAMOVRAMFree(GlamoPtr pGlamo, enum GLAMOVRAMClient client,
+	      ExaOffscreenArea *area)
+{
+	pGlamo->vram_used[client] -= area->size;
+	exaOffscreenFree(pGlamo->pScreen, area);
+	if (client == GLAMO_VRAM_PIXMAPS)
+		pGlamo->vram_fragmented = TRUE;
+}
+
+void
+GLAMOVRAMReport(GlamoPtr pGlamo)
+{
+	int scrnIndex = pGlamo->pScreen->myNum;
+	unsigned long left = pGlamo->vram_size - pGlamo->vram_scanout;
+	int i;
+
+	for (i = 0; i < NB_GLAMO_VRAM_CLIENTS; i++) {
+		if (!pGlamo->vram_used[i])
+			continue;
+		xf86DrvMsg(scrnIndex, X_INFO, "VRAM used by the %s: "
+			   "%lukB\n", GLAMOVRAMClientNames[i],
+			   pGlamo->vram_used[i] / 1024);
+		left -= pGlamo->vram_used[i];
+	}
+
+	xf86DrvMsg(scrnIndex, X_INFO,
+		   "VRAM left for pixmaps: %lukB\n", left / 1024);
+}
+
+void
+GLAMOVRAMGetStats(GlamoPtr pGlamo, GlamoVRAMStatsPtr stats)
+{
+	ExaOffscreenArea *area;
+
+	stats->free_blocks = 0;
+	stats->free = 0;
+	stats->largest = 0;
+
+	for (area = pGlamo->exa->offScreenAreas; area; area = area->next) {
+		if (area->state != ExaOffscreenAvail)
+			continue;
+		stats->free_blocks++;
+		stats->free += area->size;
+		if (area->size > stats->largest)
+			stats->largest = area->size;
+	}
+}
+
+/*
+ * EXA compacts the heap from its wakeup handler when the server is idle,
+ * moving pixmaps with overlapping copies.  It only moves the pixmaps it
+ * allocates itself, so with DriverPixmaps GLAMOPixmapCompact does the
+ * same for ours.  The first move takes a snapshot of the heap, and the
+ * next block handler reports the result.
+ */
+void
+GLAMOVRAMCompactStart(GlamoPtr pGlamo)
+{
+	if (!pGlamo->vram_compacting) {
+		GLAMOVRAMGetStats(pGlamo, &pGlamo->vram_before);
+		pGlamo->vram_compacting = TRUE;
+		pGlamo->vram_compactions++;
+	}
+	pGlamo->vram_moves++;
+}
+
+void
+GLAMOVRAMCompactDone(GlamoPtr pGlamo)
+{
+	GlamoVRAMStatsRec after;
+
+	if (!pGlamo->vram_compacting)
+		return;
+
+	GLAMOVRAMGetStats(pGlamo, &after);
+	xf86DrvMsgVerb(pGlamo->pScreen->myNum, X_INFO, 3,
+		       "Compacted offscreen memory: %d free blocks, largest "
+		       "%lukB of %lukB before; %d free blocks, largest %lukB "
+		       "of %lukB after\n",
+		       pGlamo->vram_before.free_blocks,
+		       pGlamo->vram_before.largest / 1024,
+		       pGlamo->vram_before.free / 1024,
+		       after.free_blocks, after.largest / 1024,
+		       after.free / 1024);
+	pGlamo->vram_compacting = FALSE;
+}
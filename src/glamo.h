@@ -34,8 +34,11 @@
 #include "config.h"
 #endif
 
+#include <sys/time.h>
 #include "xf86.h"
+#include "xf86Crtc.h"
 #include "exa.h"
+#include "shadow.h"
 #include <linux/fb.h>
 
 #define GLAMO_REG_BASE(c)		((c)->attr.address[0])
@@ -75,17 +78,261 @@ MMIO_IN16(__volatile__ void *base, const unsigned long offset)
 
 typedef volatile CARD16        VOL16;
 
+/* Number of solid fill rectangles collected before they are emitted. */
+#define GLAMO_SOLID_BATCH_SIZE 64
+
+/*
+ * Size of the VRAM area uploads are staged in before being blitted to
+ * their destination.
+ */
+#define GLAMO_UPLOAD_RING_SIZE	(128 * 1024)
+
+/* The 2D engine and the LCD take 23 bit VRAM addresses. */
+#define GLAMO_VRAM_MAX		(8 * 1024 * 1024)
+
+/* Users of the VRAM the driver allocates for itself */
+enum GLAMOVRAMClient {
+	GLAMO_VRAM_CMDQ,
+	GLAMO_VRAM_MONO_CACHE,
+	GLAMO_VRAM_UPLOAD,
+	GLAMO_VRAM_CURSOR,
+	GLAMO_VRAM_PIXMAPS,
+	NB_GLAMO_VRAM_CLIENTS /*should be the last entry*/
+};
+
+/* Dispatched command batches tracked until they complete */
+#define GLAMO_FENCE_RING	64
+
+/*
+ * Pools of small pixmaps.  Each pool hands out objects of one size from
+ * slabs of GLAMO_SLAB_SIZE bytes of VRAM.
+ */
+#define GLAMO_PIXMAP_POOLS	3
+#define GLAMO_SLAB_SIZE		(64 * 1024)
+#define GLAMO_SLAB_MAX_OBJECTS	(GLAMO_SLAB_SIZE / 1024)
+
+typedef struct _GlamoSlab {
+	struct _GlamoSlab *prev;
+	struct _GlamoSlab *next;
+	ExaOffscreenArea *area;
+	int nfree;
+	int free; /* first free object, -1 if none */
+	short link[GLAMO_SLAB_MAX_OBJECTS]; /* next free object */
+} GlamoSlabRec, *GlamoSlabPtr;
+
+typedef struct {
+	int size;
+	int nslabs;
+	GlamoSlabPtr partial; /* slabs with free objects */
+	GlamoSlabPtr full;
+	unsigned long allocs;
+} GlamoPixmapPoolRec, *GlamoPixmapPoolPtr;
+
+/* Driver private of a pixmap when the driver allocates pixmaps */
+typedef struct _GlamoPixmapPriv {
+	int size; /* 0 for pixmaps wrapped around memory not ours */
+	int align; /* of the offset in VRAM */
+	PixmapPtr pixmap; /* once EXA has set up its header */
+	Bool in_vram;
+	CARD32 offset;
+	GlamoSlabPtr slab;
+	int index;
+	ExaOffscreenArea *area; /* VRAM of a pixmap too large for the pools */
+	void *sys; /* system memory if there was no room in VRAM */
+	struct _GlamoPixmapPriv *sys_next; /* pixmaps waiting for VRAM */
+	unsigned long fence; /* last command batch using the pixmap */
+	int accesses; /* by the CPU, until it gets a readback cache */
+	CARD8 *cache; /* system memory copy of the VRAM, see glamo-pixmap.c */
+	BoxRec dirty; /* bounds of what changed in VRAM since it was copied */
+	Bool solid; /* known to be all solid_color, see GLAMOPixmapSolid */
+	Pixel solid_color;
+} GlamoPixmapPrivRec, *GlamoPixmapPrivPtr;
+
+/* Operations counted by the statistics in glamo-stats.c */
+enum GLAMOStat {
+	GLAMO_STAT_SOLID,
+	GLAMO_STAT_COPY,
+	GLAMO_STAT_COMPOSITE,
+	GLAMO_STAT_UPLOAD,
+	GLAMO_STAT_DOWNLOAD,
+	GLAMO_STAT_GLYPHS,
+	GLAMO_STAT_BITMAP,
+	GLAMO_STAT_PATTERN_FILL,
+	GLAMO_STAT_SHADOW,
+	GLAMO_STAT_SHADOW_READBACK,
+	NB_GLAMO_STATS /*should be the last entry*/
+};
+
+/* Why a solid or copy was left to software. */
+enum GLAMOFallback {
+	GLAMO_FALLBACK_BPP,
+	GLAMO_FALLBACK_PLANEMASK,
+	GLAMO_FALLBACK_OVERLAP_PITCH,
+	GLAMO_FALLBACK_BYTE_ALIGN,
+	GLAMO_FALLBACK_PITCH,
+	GLAMO_FALLBACK_SHADOW,
+	NB_GLAMO_FALLBACKS /*should be the last entry*/
+};
+
+typedef struct {
+	unsigned long calls;
+	unsigned long pixels;
+	unsigned long bytes; /* moved between system memory and VRAM */
+	unsigned long usec; /* only with the StatsTiming option */
+	struct timeval start;
+} GlamoStatRec, *GlamoStatPtr;
+
+/*
+ * Solids and copies of at most cpu_max pixels are written by the CPU when
+ * the pixmaps have no blits pending, as building, flushing and waiting
+ * for a command costs more.  The crossover is measured when acceleration
+ * is enabled unless set with the CPUSolidPixels and CPUCopyPixels
+ * options.
+ */
+enum GLAMOCostOp {
+	GLAMO_COST_SOLID,
+	GLAMO_COST_COPY,
+	NB_GLAMO_COST_OPS /*should be the last entry*/
+};
+
+typedef struct {
+	int cpu_max;
+	unsigned long cpu_boxes;
+	unsigned long cpu_pixels;
+	unsigned long busy; /* small boxes blitted all the same */
+} GlamoCostRec, *GlamoCostPtr;
+
+/*
+ * Part of an 8bpp solid or copy the blitter can't do in 16 bit units,
+ * left to the CPU.  Solids have no source.
+ */
+#define GLAMO_BYTE_RECTS	64
+
+typedef struct {
+	short sx, sy;
+	short dx, dy;
+	short w, h;
+} GlamoByteRectRec, *GlamoByteRectPtr;
+
+/* Free space of the offscreen heap */
+typedef struct {
+	int free_blocks;
+	unsigned long free;
+	unsigned long largest;
+} GlamoVRAMStatsRec, *GlamoVRAMStatsPtr;
+
+/* A pixmap as the 2D engine addresses it */
+typedef struct {
+	CARD32 offset;
+	int pitch;
+} GlamoSurfaceRec, *GlamoSurfacePtr;
+
+/* Copies n bytes between system memory and VRAM. */
+typedef void (*GlamoCopyRowProc)(CARD8 *dst, const CARD8 *src, int n);
+
+/*
+ * Blend n premultiplied a8r8g8b8 pixels Over r5g6b5 ones, from a row or
+ * from a solid colour through an a8 mask.
+ */
+typedef void (*GlamoOverRowProc)(CARD16 *dst, const CARD32 *src, int n);
+typedef void (*GlamoOverMaskRowProc)(CARD16 *dst, CARD32 color,
+				     const CARD8 *mask, int n);
+
+/*
+ * Convert n x8r8g8b8 pixels to r5g6b5.  dither, if not NULL, holds the
+ * ordered dither thresholds of 8 consecutive pixels of the row.
+ */
+typedef void (*GlamoConvertRowProc)(CARD16 *dst, const CARD32 *src, int n,
+				    const CARD8 *dither);
+
+#if defined(__ARM_ARCH_5TE__) || defined(__ARM_ARCH_5TEJ__) || \
+    defined(__ARM_ARCH_6__) || defined(__ARM_ARCH_6J__) || \
+    defined(__ARM_ARCH_6K__) || defined(__ARM_ARCH_6Z__) || \
+    defined(__ARM_ARCH_6ZK__) || defined(__ARM_ARCH_7A__)
+#define GLAMO_HAVE_PLD 1
+#endif
+
 typedef struct _MemBuf {
 	int size;
 	int used;
 	void *address;
 } MemBuf;
 
+/*
+ * Cache of colour expanded 1bpp bitmaps (glyphs, small bitmaps) in VRAM.
+ * The cache surface is split into cells of GLAMO_MONO_CELL_SIZE pixels
+ * square which are organised as a set associative cache.
+ */
+#define GLAMO_MONO_CELL_SIZE	32
+#define GLAMO_MONO_CACHE_COLS	16
+#define GLAMO_MONO_CACHE_ROWS	8
+#define GLAMO_MONO_CACHE_CELLS	(GLAMO_MONO_CACHE_COLS * GLAMO_MONO_CACHE_ROWS)
+#define GLAMO_MONO_CACHE_WAYS	4
+#define GLAMO_MONO_CACHE_SETS	(GLAMO_MONO_CACHE_CELLS / GLAMO_MONO_CACHE_WAYS)
+
+typedef struct {
+	CARD32 bits[GLAMO_MONO_CELL_SIZE]; /* bit x of bits[y] is pixel (x, y) */
+	CARD32 hash;
+	CARD16 width;
+	CARD16 height;
+	CARD16 fg;
+	CARD16 bg;
+	CARD16 x; /* position of the cell in the cache surface */
+	CARD16 y;
+	unsigned long last_use;
+	Bool valid;
+} GlamoMonoCellRec, *GlamoMonoCellPtr;
+
+typedef struct {
+	ExaOffscreenArea *area;
+	CARD32 offset;
+	int pitch;
+	/*
+	 * Cells used by the batch being built carry the current serial and
+	 * must not be replaced.  Batches before idle_serial have completed.
+	 */
+	unsigned long serial;
+	unsigned long idle_serial;
+	unsigned long hits;
+	unsigned long misses;
+	GlamoMonoCellRec cells[GLAMO_MONO_CACHE_CELLS];
+} GlamoMonoCacheRec, *GlamoMonoCachePtr;
+
+/* How an accelerated Render composite is carried out by the 2D engine. */
+enum GLAMOCompositeMode {
+	GLAMO_COMPOSITE_COPY,
+	GLAMO_COMPOSITE_FILL,
+	GLAMO_COMPOSITE_NOOP,
+	GLAMO_COMPOSITE_BLEND,
+	GLAMO_COMPOSITE_CONVERT,
+	GLAMO_COMPOSITE_TILE,
+	NB_GLAMO_COMPOSITE_MODES /*should be the last entry*/
+};
+
+/* Why a Render composite was left to software. */
+enum GLAMOCompositeFallback {
+	GLAMO_COMPOSITE_FALLBACK_OP,
+	GLAMO_COMPOSITE_FALLBACK_MASK,
+	GLAMO_COMPOSITE_FALLBACK_SOURCE_PICT,
+	GLAMO_COMPOSITE_FALLBACK_ALPHA_MAP,
+	GLAMO_COMPOSITE_FALLBACK_TRANSFORM,
+	GLAMO_COMPOSITE_FALLBACK_REPEAT,
+	GLAMO_COMPOSITE_FALLBACK_SRC_FORMAT,
+	GLAMO_COMPOSITE_FALLBACK_DST_FORMAT,
+	GLAMO_COMPOSITE_FALLBACK_TRANSLUCENT,
+	GLAMO_COMPOSITE_FALLBACK_PREPARE,
+	GLAMO_COMPOSITE_FALLBACK_SHADOW,
+	NB_GLAMO_COMPOSITE_FALLBACKS /*should be the last entry*/
+};
+
 typedef struct {
 	Bool					shadowFB;
 	void					*shadow;
+	RegionRec				shadow_stale; /* blitted after the shadow */
+	Bool					copy_to_shadow;
 	CloseScreenProcPtr		CloseScreen;
 	CreateScreenResourcesProcPtr CreateScreenResources;
+	CreateGCProcPtr			CreateGC;
 	void					(*PointerMoved)(int index, int x, int y);
 	EntityInfoPtr			pEnt;
 	OptionInfoPtr			Options;
@@ -95,6 +342,46 @@ typedef struct {
 	ExaDriverPtr exa;
 	ExaOffscreenArea *exa_cmd_queue;
 
+	/* VRAM budget, see glamo-vram.c */
+	unsigned long vram_size;
+	unsigned long vram_scanout;
+	unsigned long vram_used[NB_GLAMO_VRAM_CLIENTS];
+
+	/* Pixmaps are allocated by the driver rather than by EXA. */
+	Bool driver_pixmaps;
+	GlamoPixmapPoolRec pixmap_pools[GLAMO_PIXMAP_POOLS];
+	unsigned long pixmap_sys_allocs;
+	unsigned long pixmap_migrations;
+	GlamoPixmapPrivPtr pixmap_sys; /* list of those in system memory */
+
+	/* Readback caches of hot pixmaps, within the ReadbackCache budget. */
+	unsigned long readback_budget;
+	unsigned long readback_used;
+	unsigned long readback_hits;
+	unsigned long readback_refreshed;
+	unsigned long readback_written;
+
+	/* Work saved on pixmaps known to be one colour */
+	unsigned long solid_fills_dropped;
+	unsigned long solid_copies_filled;
+	unsigned long solid_readbacks;
+
+	/* Sources of CPU conversions read from a readback cache, or VRAM */
+	unsigned long convert_cached;
+	unsigned long convert_vram;
+
+	/* Heap compaction since the last block handler, and in total */
+	Bool vram_fragmented; /* pixmap VRAM freed since the last pass */
+	Bool vram_compacting;
+	GlamoVRAMStatsRec vram_before;
+	unsigned long vram_moves;
+	unsigned long vram_compactions;
+
+	/* Hardware cursor image, see glamo-cursor.c */
+	Bool hw_cursor;
+	ExaOffscreenArea *cursor_area;
+	Bool (*UseHWCursorARGB)(ScreenPtr pScreen, CursorPtr pCurs);
+
 	CARD16 *ring_addr; /* Beginning of ring buffer. */
 	int ring_len;
 
@@ -105,6 +392,184 @@ typedef struct {
 	 */
 	MemBuf *cmd_queue_cache;
 
+	/*
+	 * Rectangles queued by Solid, emitted in one go when the batch is
+	 * full or by DoneSolid.
+	 */
+	BoxRec solid_boxes[GLAMO_SOLID_BATCH_SIZE];
+	int solid_nbox;
+
+	/*
+	 * Pixel of the current solid if its raster op is GXcopy, which leaves
+	 * the pixmap all that colour when a box covers it.  copy_as_solid is
+	 * set when the source of a copy is known to be one colour and the
+	 * copy is done as a solid.
+	 */
+	Bool solid_gxcopy;
+	Pixel solid_fg;
+	Bool copy_as_solid;
+
+	/*
+	 * Destination box of the last copy, held back to be merged with the
+	 * next ones if they continue it with the same source offset.
+	 */
+	Bool copy_held;
+	BoxRec copy_held_box;
+	int copy_held_dx;
+	int copy_held_dy;
+
+	/*
+	 * Copies with the same source offset, queued to be drawn as one blit
+	 * over their extents clipped to each of them in turn.
+	 */
+	BoxRec copy_boxes[GLAMO_SOLID_BATCH_SIZE];
+	int copy_nbox;
+	int copy_dx;
+	int copy_dy;
+
+	/* Boxes merged into others before being drawn */
+	unsigned long solid_merged;
+	unsigned long copy_merged;
+
+	/*
+	 * Clip rectangle last written to the 2D engine, in pixmap coordinates
+	 * with exclusive right and bottom edges, and what using it has saved.
+	 */
+	Bool hw_clip;
+	BoxRec hw_clip_box;
+	unsigned long hw_clip_requests;
+	long hw_clip_words_saved;
+
+	/*
+	 * Command batches are numbered as they are dispatched: fence batches
+	 * have been dispatched and the ones up to fence_retired have
+	 * completed.  The batch being queued is fence + 1.  fence_end holds
+	 * where in the ring each batch not known to be retired ends.
+	 */
+	unsigned long fence;
+	unsigned long fence_retired;
+	CARD32 fence_end[GLAMO_FENCE_RING];
+	unsigned long fence_waits;
+	unsigned long fence_skips;
+
+	/*
+	 * The current solid or copy is on 8bpp pixmaps, drawn as 16bpp with
+	 * the odd columns queued for the CPU.
+	 */
+	Bool draw_bytes;
+	int byte_alu;
+	CARD8 byte_fg;
+	CARD8 *byte_src;
+	CARD8 *byte_dst;
+	int byte_src_pitch;
+	int byte_dst_pitch;
+	GlamoByteRectRec byte_rects[GLAMO_BYTE_RECTS];
+	int byte_nrect;
+
+	/*
+	 * The current solid or copy may write small boxes with the CPU,
+	 * through these pointers.  draw_blitted once a box went to the
+	 * blitter; until then the setup commands, which end at
+	 * cpu_setup_end in the command cache, are dropped if it completes.
+	 */
+	GlamoCostRec cost[NB_GLAMO_COST_OPS];
+	Bool cpu_ok;
+	Bool draw_blitted;
+	int cpu_setup_end;
+	int cpu_setup_words;
+	CARD16 cpu_fg;
+	CARD8 *cpu_src;
+	CARD8 *cpu_dst;
+	int cpu_src_pitch;
+	int cpu_dst_pitch;
+
+	/* Source and destination of the current copy are the same pixmap. */
+	Bool copy_same_pixmap;
+	PixmapPtr copy_src;
+
+	/*
+	 * Distance in bytes from the source to the destination of a copy
+	 * between different pixmaps sharing VRAM, as EXA does when it
+	 * compacts the offscreen heap; 0 if they don't overlap.
+	 */
+	long copy_shift;
+	int copy_pitch;
+	int copy_height; /* of the destination, to set the engine up again */
+	unsigned long copy_bounced; /* through the staging ring */
+
+	/*
+	 * The current solid or copy involves a pixmap larger than the 2D
+	 * engine can address, and is drawn in pieces from these surfaces.
+	 */
+	Bool solid_split;
+	Bool copy_split;
+	GlamoSurfaceRec split_src;
+	GlamoSurfaceRec split_dst;
+	unsigned long split_pieces;
+
+	/* State of the composite between PrepareComposite and DoneComposite */
+	enum GLAMOCompositeMode composite_mode;
+	Bool composite_over;
+	PixmapPtr composite_src;
+	/*
+	 * Tile of a repeating composite: the source pixmap, or one period
+	 * of it converted to r5g6b5 in the upload ring.
+	 */
+	GlamoSurfaceRec composite_tile;
+	/*
+	 * What a blending composite reads: rows of the source, or a solid
+	 * colour through rows of the mask, see glamo-blend.c.  The rows are
+	 * those of the readback caches when the pixmaps have one.
+	 */
+	CARD32 blend_color;
+	CARD8 *blend_src;
+	CARD8 *blend_mask;
+	CARD8 *blend_dst_cache;
+	int blend_src_pitch;
+	int blend_mask_pitch;
+
+	GlamoMonoCacheRec mono_cache;
+
+	/*
+	 * Staging ring for uploads.  Data is written linearly from head on;
+	 * wrapping around waits for the blits reading the old data.
+	 */
+	ExaOffscreenArea *upload_area;
+	CARD32 upload_head;
+	unsigned long upload_staged;
+	unsigned long upload_direct;
+	unsigned long upload_wraps;
+
+	/* Copy loops picked for the CPU by GLAMOTransferInit */
+	GlamoCopyRowProc upload_row;
+	GlamoCopyRowProc download_row;
+	GlamoConvertRowProc convert_row;
+	const char *transfer_name;
+	Bool dither; /* conversions to r5g6b5 */
+
+	/* Blend kernels picked by GLAMOBlendInit */
+	GlamoOverRowProc blend_over;
+	GlamoOverMaskRowProc blend_over_mask;
+	const char *blend_name;
+
+	/* Render composite statistics, reported when the screen is closed. */
+	unsigned long composite_accel[NB_GLAMO_COMPOSITE_MODES];
+	unsigned long composite_fallback[NB_GLAMO_COMPOSITE_FALLBACKS];
+
+	/*
+	 * Per operation counters and fallback reasons, see glamo-stats.c.
+	 * Fallbacks are logged at most every GLAMO_FALLBACK_LOG_INTERVAL.
+	 */
+	Bool stats_timing;
+	GlamoStatRec stats[NB_GLAMO_STATS];
+	unsigned long fallbacks[NB_GLAMO_FALLBACKS];
+	unsigned long fallbacks_logged;
+	CARD32 fallback_log_time;
+	xf86OutputPtr stats_output;
+	Atom stats_atom;
+	unsigned long stats_sum;
+	CARD32 stats_time;
+
 	/* What was GLAMOCardInfo */
 	volatile char *reg_base;
 	Bool is_3362;
@@ -153,6 +618,235 @@ GLAMODrawFini(ScreenPtr pScreen);
 Bool
 GLAMODrawExaInit(ScreenPtr pScreen, ScrnInfoPtr pScrn);
 
+/* glamo-cache.c */
+Bool
+GLAMOMonoCacheInit(GlamoPtr pGlamo);
+
+void
+GLAMOMonoCacheFini(GlamoPtr pGlamo);
+
+void
+GLAMOMonoCacheNewBatch(GlamoPtr pGlamo);
+
+GlamoMonoCellPtr
+GLAMOMonoCacheGet(GlamoPtr pGlamo, const CARD32 *bits, int width, int height,
+		  CARD16 fg, CARD16 bg);
+
+/* glamo-vram.c */
+Bool
+GLAMOVRAMInit(ScrnInfoPtr pScrn, ExaDriverPtr exa);
+
+ExaOffscreenArea *
+GLAMOVRAMAlloc(GlamoPtr pGlamo, enum GLAMOVRAMClient client, int size);
+
+ExaOffscreenArea *
+GLAMOVRAMAllocAligned(GlamoPtr pGlamo, enum GLAMOVRAMClient client, int size,
+		      int align);
+
+void
+GLAMOVRAMFree(GlamoPtr pGlamo, enum GLAMOVRAMClient client,
+	      ExaOffscreenArea *area);
+
+void
+GLAMOVRAMReport(GlamoPtr pGlamo);
+
+void
+GLAMOVRAMGetStats(GlamoPtr pGlamo, GlamoVRAMStatsPtr stats);
+
+void
+GLAMOVRAMCompactStart(GlamoPtr pGlamo);
+
+void
+GLAMOVRAMCompactDone(GlamoPtr pGlamo);
+
+/* glamo-pixmap.c */
+void *
+GLAMOExaCreatePixmap(ScreenPtr pScreen, int size, int align);
+
+void
+GLAMOExaDestroyPixmap(ScreenPtr pScreen, void *driverPriv);
+
+Bool
+GLAMOExaModifyPixmapHeader(PixmapPtr pPixmap, int width, int height,
+			   int depth, int bitsPerPixel, int devKind,
+			   pointer pPixData);
+
+Bool
+GLAMOExaPrepareAccess(PixmapPtr pPix, int index);
+
+void
+GLAMOExaFinishAccess(PixmapPtr pPix, int index);
+
+Bool
+GLAMOExaPixmapIsOffscreen(PixmapPtr pPix);
+
+void
+GLAMOPixmapInit(GlamoPtr pGlamo);
+
+void
+GLAMOPixmapFini(GlamoPtr pGlamo);
+
+void
+GLAMOPixmapCompact(GlamoPtr pGlamo);
+
+void
+GLAMOPixmapMigrate(GlamoPtr pGlamo);
+
+CARD32
+GLAMOPixmapOffset(PixmapPtr pPix);
+
+Bool
+GLAMOPixmapInVRAM(GlamoPtr pGlamo, PixmapPtr pPix);
+
+void
+GLAMOPixmapFence(GlamoPtr pGlamo, PixmapPtr pPix);
+
+void
+GLAMOPixmapWait(GlamoPtr pGlamo, PixmapPtr pPix);
+
+Bool
+GLAMOPixmapIdle(GlamoPtr pGlamo, PixmapPtr pPix);
+
+void
+GLAMOPixmapDirty(GlamoPtr pGlamo, PixmapPtr pPix, int x1, int y1, int x2,
+		 int y2);
+
+CARD8 *
+GLAMOPixmapCache(GlamoPtr pGlamo, PixmapPtr pPix);
+
+void
+GLAMOPixmapSolid(GlamoPtr pGlamo, PixmapPtr pPix, Bool solid, Pixel color);
+
+Bool
+GLAMOPixmapIsSolid(GlamoPtr pGlamo, PixmapPtr pPix, Pixel *color);
+
+void
+GLAMOFillMemory(CARD8 *dst, int pitch, int bpp, int w, int h, Pixel color);
+
+/* glamo-stats.c */
+void
+GLAMOStatBegin(GlamoPtr pGlamo, enum GLAMOStat stat);
+
+void
+GLAMOStatEnd(GlamoPtr pGlamo, enum GLAMOStat stat, unsigned long pixels,
+	     unsigned long bytes);
+
+void
+GLAMOStatFallback(GlamoPtr pGlamo, enum GLAMOFallback reason);
+
+void
+GLAMOStatsOutputInit(xf86OutputPtr output);
+
+void
+GLAMOStatsUpdate(GlamoPtr pGlamo);
+
+void
+GLAMOStatsReport(GlamoPtr pGlamo);
+
+/* glamo-transfer.c */
+void
+GLAMOTransferInit(ScrnInfoPtr pScrn);
+
+void
+GLAMOTransferRect(GlamoCopyRowProc copy, CARD8 *dst, int dst_pitch,
+		  const CARD8 *src, int src_pitch, int n, int h);
+
+void
+GLAMOConvertRect(GlamoPtr pGlamo, CARD8 *dst, int dst_pitch,
+		 const CARD8 *src, int src_pitch, int x, int y, int w, int h);
+
+#if defined(__ARM_NEON__)
+Bool
+GLAMOHaveNeon(void);
+#endif
+
+/* glamo-blend.c */
+void
+GLAMOBlendInit(ScrnInfoPtr pScrn);
+
+Bool
+GLAMOBlendCheck(int op, PicturePtr pSrcPicture, PicturePtr pMaskPicture,
+		PicturePtr pDstPicture);
+
+Bool
+GLAMOBlendPrepare(GlamoPtr pGlamo, PicturePtr pSrcPicture, PixmapPtr pSrc,
+		  PixmapPtr pMask, PixmapPtr pDst);
+
+void
+GLAMOBlendComposite(GlamoPtr pGlamo, PixmapPtr pDst, int srcX, int srcY,
+		    int maskX, int maskY, int dstX, int dstY,
+		    int width, int height);
+
+CARD8 *
+GLAMOBlendPixels(GlamoPtr pGlamo, PixmapPtr pPix);
+
+CARD8 *
+GLAMOConvertPixels(GlamoPtr pGlamo, PixmapPtr pSrc);
+
+Bool
+GLAMOConvertCheck(int op, PicturePtr pSrcPicture, PicturePtr pMaskPicture,
+		  PicturePtr pDstPicture);
+
+Bool
+GLAMOConvertPrepare(GlamoPtr pGlamo, PixmapPtr pSrc, PixmapPtr pDst);
+
+void
+GLAMOConvertComposite(GlamoPtr pGlamo, PixmapPtr pDst, int srcX, int srcY,
+		      int dstX, int dstY, int width, int height);
+
+/* glamo-gc.c */
+Bool
+GLAMOGCInit(ScreenPtr pScreen);
+
+void
+GLAMOGCFini(ScreenPtr pScreen);
+
+void
+GLAMOTileBoxes(GlamoPtr pGlamo, CARD32 src_offset, int src_pitch,
+	       int sx, int sy, int pw, int ph, PixmapPtr pDst,
+	       BoxPtr pbox, int nbox, int orgx, int orgy, int xoff, int yoff);
+
+/* glamo-cursor.c */
+Bool
+GLAMOCursorInit(ScreenPtr pScreen);
+
+void
+GLAMOCursorFini(ScreenPtr pScreen);
+
+void
+GlamoCrtcSetCursorColors(xf86CrtcPtr crtc, int bg, int fg);
+
+void
+GlamoCrtcSetCursorPosition(xf86CrtcPtr crtc, int x, int y);
+
+void
+GlamoCrtcShowCursor(xf86CrtcPtr crtc);
+
+void
+GlamoCrtcHideCursor(xf86CrtcPtr crtc);
+
+void
+GlamoCrtcLoadCursorImage(xf86CrtcPtr crtc, CARD8 *image);
+
+void
+GlamoCrtcLoadCursorARGB(xf86CrtcPtr crtc, CARD32 *image);
+
+/* glamo-shadow.c */
+Bool
+GLAMOShadowIsScreen(GlamoPtr pGlamo, PixmapPtr pPix);
+
+Bool
+GLAMOShadowCanBlit(GlamoPtr pGlamo, PixmapPtr pDst);
+
+void
+GLAMOShadowBlitted(GlamoPtr pGlamo, int x1, int y1, int x2, int y2);
+
+void
+GLAMOShadowSync(GlamoPtr pGlamo, PixmapPtr pPix);
+
+void
+GLAMOShadowUpdate(ScreenPtr pScreen, shadowBufPtr pBuf);
+
 /* glamo-display.h */
 Bool
 GlamoCrtcInit(ScrnInfoPtr pScrn);